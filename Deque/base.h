@@ -8,5 +8,7 @@ using namespace std;
 
 typedef unsigned int uint;
 
+const size_t cache_line_size = 64;
+
 #define dbg(x) cerr << #x << ' ' << (x) << ' ' << __LINE__ << endl;
 #define fori(i, n) for (int i = 0; i < (int)(n); i++)
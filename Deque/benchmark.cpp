@@ -0,0 +1,1032 @@
+#include "base.h"
+#include "deque.h"
+#include "deque_algorithm.h"
+#include "deque_io.h"
+#include "mremap_allocator.h"
+#include "spsc_deque.h"
+#include "mpmc_queue.h"
+#include "thread_pool.h"
+#include "parallel_algorithm.h"
+#include "blocking_deque.h"
+#include "deque_simd.h"
+#include "circular_buffer.h"
+#include "sliding_window.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Benchmark of Deque against std::deque, std::vector and std::list.
+ *
+ * Every (container, element size, workload) case runs --warmup untimed and
+ * --reps timed repetitions on a freshly prepared container; only the workload
+ * itself is inside the timed region; inputs (values, indices, operation
+ * sequences) are generated up front. The report gives min / p50 / p90 / p99 /
+ * max per repetition and the p50 cost per operation.
+ *
+ * The growth suite instead measures, for ints and sizes from 10 to 10^6, the
+ * cost of filling a container from empty and the single push_back that
+ * doubles a full Deque ring, with and without mremap_allocator.
+ *
+ * The remaining suites compare the specialised paths against their plain
+ * counterparts at --size elements: bulk (append, linearize, segmented scans,
+ * save/load),
+ * simd (every kernel level up to the detected one), window (CircularBuffer and
+ * the sliding-window aggregates) and concurrency (the queues and ThreadPool,
+ * for 1, 2, 4, ... threads up to the hardware concurrency, and parallel_sort).
+ *
+ *   deque_benchmark [--suite=containers|growth|bulk|simd|window|concurrency|all]
+ *                   [--size=N] [--reps=N] [--warmup=N] [--filter=substr]
+ *                   [--format=table|csv|json] [--out=path]
+ */
+
+struct bench_options
+{
+    int size = 1 << 20;
+    int reps = 11;
+    int warmup = 2;
+    string suite = "containers";
+    string filter;
+    string format = "table";
+    string out;
+};
+
+struct bench_result
+{
+    string container, workload;
+    size_t element_size;
+    int size, ops, reps;
+    double min_ns, p50_ns, p90_ns, p99_ns, max_ns, mean_ns;
+};
+
+template <size_t Bytes> struct payload
+{
+    uint32_t key;
+    char pad[Bytes - sizeof(uint32_t)];
+
+    payload(uint32_t value = 0)
+        : key(value)
+    {
+        memset(pad, (int)(value & 0xff), sizeof(pad));
+    }
+
+    bool operator < (const payload & obj) const
+    {
+        return key < obj.key;
+    }
+};
+
+inline uint32_t keyOf(int value)
+{
+    return (uint32_t)value;
+}
+
+template <size_t Bytes> uint32_t keyOf(const payload<Bytes>& value)
+{
+    return value.key;
+}
+
+// Keeps the compiler from discarding the result of a workload.
+volatile uint64_t bench_sink;
+
+// Placeholder state for workloads that build their own containers and threads.
+struct bench_task
+{
+};
+
+const char* const bench_suites[] = { "containers", "growth", "bulk", "simd", "window", "concurrency", "all" };
+
+template <typename C> struct container_traits
+{
+    static const bool front_ops = true;
+    static const bool random_access = true;
+};
+
+template <typename T> struct container_traits<vector<T> >
+{
+    static const bool front_ops = false;
+    static const bool random_access = true;
+};
+
+template <typename T> struct container_traits<list<T> >
+{
+    static const bool front_ops = true;
+    static const bool random_access = false;
+};
+
+template <typename T> struct bench_input
+{
+    vector<T> values;
+    vector<int> indices;
+    vector<uint8_t> ops;
+
+    bench_input(int size)
+    {
+        mt19937 engine(12345);
+        values.reserve(size);
+        indices.reserve(size);
+        ops.reserve(size);
+        fori(i, size)
+        {
+            values.push_back(T((int)(engine() & 0x7fffffff)));
+            indices.push_back((int)(engine() % (uint32_t)size));
+            ops.push_back((uint8_t)(engine() % 6));
+        }
+    }
+};
+
+enum bench_setup
+{
+    setup_empty,
+    setup_filled
+};
+
+template <typename C, typename T> void fill(C& c, const bench_input<T>& in)
+{
+    for (const T& value : in.values)
+        c.push_back(value);
+}
+
+template <typename C> void sortContainer(C& c)
+{
+    sort(c.begin(), c.end());
+}
+
+template <typename T> void sortContainer(list<T>& c)
+{
+    c.sort();
+}
+
+// Half appended, half prepended, so the elements wrap around the end of the ring.
+template <typename T> void fillWrapped(Deque<T>& d, const vector<T>& values)
+{
+    d.append(values.begin() + values.size() / 2, values.end());
+    d.prepend(values.begin(), values.begin() + values.size() / 2);
+}
+
+uint64_t parallelSum(ThreadPool& pool, const int* first, const int* last)
+{
+    if (last - first <= 16 * 1024)
+    {
+        uint64_t sum = 0;
+        for (; first != last; ++first)
+            sum += *first;
+        return sum;
+    }
+    const int* middle = first + (last - first) / 2;
+    uint64_t left = 0;
+    TaskGroup group(pool);
+    group.run([&pool, &left, first, middle]() { left = parallelSum(pool, first, middle); });
+    uint64_t right = parallelSum(pool, middle, last);
+    group.wait();
+    return left + right;
+}
+
+/*
+ * Workloads. Each returns a checksum; the ones that need front operations or
+ * indexing are only instantiated for containers that provide them.
+ */
+
+template <typename C, typename T> uint64_t runPushBack(C& c, const bench_input<T>& in)
+{
+    for (const T& value : in.values)
+        c.push_back(value);
+    return (uint64_t)c.size();
+}
+
+template <typename C, typename T> uint64_t runPushFront(C& c, const bench_input<T>& in)
+{
+    for (const T& value : in.values)
+        c.push_front(value);
+    return (uint64_t)c.size();
+}
+
+template <typename C, typename T> uint64_t runPopBack(C& c, const bench_input<T>&)
+{
+    uint64_t sum = 0;
+    while (!c.empty())
+    {
+        sum += keyOf(c.back());
+        c.pop_back();
+    }
+    return sum;
+}
+
+template <typename C, typename T> uint64_t runPopFront(C& c, const bench_input<T>&)
+{
+    uint64_t sum = 0;
+    while (!c.empty())
+    {
+        sum += keyOf(c.front());
+        c.pop_front();
+    }
+    return sum;
+}
+
+template <typename C, typename T> uint64_t runRandomAccess(C& c, const bench_input<T>& in)
+{
+    uint64_t sum = 0;
+    for (int index : in.indices)
+        sum += keyOf(c[index]);
+    return sum;
+}
+
+template <typename C, typename T> uint64_t runIterate(C& c, const bench_input<T>&)
+{
+    uint64_t sum = 0;
+    for (const auto& value : c)
+        sum += keyOf(value);
+    return sum;
+}
+
+template <typename C, typename T> uint64_t runSort(C& c, const bench_input<T>&)
+{
+    sortContainer(c);
+    return keyOf(c.front());
+}
+
+// Grow to the full size and drain again, four times, through the queue ends.
+template <typename C, typename T> uint64_t runChurn(C& c, const bench_input<T>& in)
+{
+    uint64_t sum = 0;
+    fori(cycle, 4)
+    {
+        for (const T& value : in.values)
+            c.push_back(value);
+        while (!c.empty())
+        {
+            sum += keyOf(c.front());
+            c.pop_front();
+        }
+    }
+    return sum;
+}
+
+// Random mix of pushes, pops and end reads starting from a full container.
+template <typename C, typename T> uint64_t runMixed(C& c, const bench_input<T>& in)
+{
+    uint64_t sum = 0;
+    size_t next = 0;
+    for (uint8_t op : in.ops)
+    {
+        const T& value = in.values[next++];
+        switch (op)
+        {
+        case 0:
+            c.push_back(value);
+            break;
+        case 1:
+            c.push_front(value);
+            break;
+        case 2:
+            if (!c.empty())
+                c.pop_back();
+            break;
+        case 3:
+            if (!c.empty())
+                c.pop_front();
+            break;
+        default:
+            if (!c.empty())
+                sum += keyOf(op == 4 ? c.front() : c.back());
+        }
+    }
+    return sum + (uint64_t)c.size();
+}
+
+class Benchmark
+{
+    bench_options options;
+    vector<bench_result> results;
+
+    static double percentile(const vector<double>& sorted, double p)
+    {
+        size_t rank = (size_t)(p * (sorted.size() - 1) + 0.5);
+        return sorted[min(rank, sorted.size() - 1)];
+    }
+
+    // Times work(c) on a container freshly set up by prepare(c); c is destroyed outside the timed region.
+    template <typename C, typename Prepare, typename Work>
+    void measureRuns(const string& container, const string& workload, size_t element_size, int size, int ops,
+                     Prepare prepare, Work work)
+    {
+        string name = container + "/" + to_string(element_size) + "/" + workload + "/" + to_string(size);
+        if (!options.filter.empty() && name.find(options.filter) == string::npos)
+            return;
+
+        vector<double> samples;
+        fori(rep, options.warmup + options.reps)
+        {
+            C c;
+            prepare(c);
+            auto start_time = chrono::steady_clock::now();
+            bench_sink = bench_sink + work(c);
+            auto duration = chrono::steady_clock::now() - start_time;
+            if (rep >= options.warmup)
+                samples.push_back((double)chrono::duration_cast<chrono::nanoseconds>(duration).count());
+        }
+        sort(samples.begin(), samples.end());
+
+        bench_result result;
+        result.container = container;
+        result.workload = workload;
+        result.element_size = element_size;
+        result.size = size;
+        result.ops = ops;
+        result.reps = options.reps;
+        result.min_ns = samples.front();
+        result.p50_ns = percentile(samples, 0.5);
+        result.p90_ns = percentile(samples, 0.9);
+        result.p99_ns = percentile(samples, 0.99);
+        result.max_ns = samples.back();
+        double total = 0;
+        for (double sample : samples)
+            total += sample;
+        result.mean_ns = total / samples.size();
+        results.push_back(result);
+        cerr << name << ": p50 " << result.p50_ns / 1e6 << " ms" << endl;
+    }
+
+    template <typename C, typename T, typename Work>
+    void measure(const string& container, const string& workload, bench_setup setup,
+                 const bench_input<T>& in, Work work)
+    {
+        measureRuns<C>(container, workload, sizeof(T), options.size, options.size,
+                       [&](C& c)
+                       {
+                           if (setup == setup_filled)
+                               fill(c, in);
+                       },
+                       [&](C& c)
+                       {
+                           return work(c, in);
+                       });
+    }
+
+    template <typename C, typename T> void frontCases(const string& name, const bench_input<T>& in, true_type)
+    {
+        measure<C>(name, "push_front", setup_empty, in, runPushFront<C, T>);
+        measure<C>(name, "pop_front", setup_filled, in, runPopFront<C, T>);
+        measure<C>(name, "churn", setup_empty, in, runChurn<C, T>);
+        measure<C>(name, "mixed", setup_filled, in, runMixed<C, T>);
+    }
+
+    template <typename C, typename T> void frontCases(const string&, const bench_input<T>&, false_type)
+    {
+    }
+
+    template <typename C, typename T> void indexCases(const string& name, const bench_input<T>& in, true_type)
+    {
+        measure<C>(name, "random_access", setup_filled, in, runRandomAccess<C, T>);
+    }
+
+    template <typename C, typename T> void indexCases(const string&, const bench_input<T>&, false_type)
+    {
+    }
+
+    template <typename C, typename T> void containerCases(const string& name, const bench_input<T>& in)
+    {
+        measure<C>(name, "push_back", setup_empty, in, runPushBack<C, T>);
+        measure<C>(name, "pop_back", setup_filled, in, runPopBack<C, T>);
+        measure<C>(name, "iterate", setup_filled, in, runIterate<C, T>);
+        measure<C>(name, "sort", setup_filled, in, runSort<C, T>);
+        frontCases<C>(name, in, integral_constant<bool, container_traits<C>::front_ops>());
+        indexCases<C>(name, in, integral_constant<bool, container_traits<C>::random_access>());
+    }
+
+    template <typename T> void elementCases()
+    {
+        bench_input<T> in(options.size);
+        containerCases<Deque<T> >("Deque", in);
+        containerCases<deque<T> >("std::deque", in);
+        containerCases<vector<T> >("std::vector", in);
+        containerCases<list<T> >("std::list", in);
+    }
+
+    template <typename C> void fillCase(const string& container, int size)
+    {
+        measureRuns<C>(container, "fill", sizeof(int), size, size,
+                       [](C&)
+                       {
+                       },
+                       [size](C& c)
+                       {
+                           fori(i, size)
+                               c.push_back(i);
+                           return (uint64_t)c.size();
+                       });
+    }
+
+    // The push_back that fills a Deque ring of capacity and so doubles it.
+    template <typename C> void growSpikeCase(const string& container, int capacity)
+    {
+        measureRuns<C>(container, "grow_spike", sizeof(int), capacity, 1,
+                       [capacity](C& c)
+                       {
+                           fori(i, capacity - 1)
+                               c.push_back(i);
+                       },
+                       [](C& c)
+                       {
+                           c.push_back(0);
+                           return (uint64_t)c.size();
+                       });
+    }
+
+    void growthCases()
+    {
+        int max_size = max(1000 * 1000, options.size);
+        for (int size = 10; size <= max_size; size *= 10)
+        {
+            fillCase<Deque<int> >("Deque", size);
+            fillCase<Deque<int, mremap_allocator<int> > >("Deque+mremap", size);
+            fillCase<vector<int> >("std::vector", size);
+
+            int capacity = base_capacity;
+            while (capacity < size)
+                capacity <<= 1;
+            growSpikeCase<Deque<int> >("Deque", capacity);
+            growSpikeCase<Deque<int, mremap_allocator<int> > >("Deque+mremap", capacity);
+        }
+    }
+
+    template <typename Work>
+    void measureTask(const string& container, const string& workload, size_t element_size, int size, int ops,
+                     Work work)
+    {
+        measureRuns<bench_task>(container, workload, element_size, size, ops,
+                                [](bench_task&)
+                                {
+                                },
+                                [&](bench_task&)
+                                {
+                                    return work();
+                                });
+    }
+
+    vector<int> threadCounts() const
+    {
+        vector<int> counts;
+        int max_threads = max(2, (int)thread::hardware_concurrency());
+        for (int threads_count = 1; threads_count <= max_threads; threads_count *= 2)
+            counts.push_back(threads_count);
+        return counts;
+    }
+
+    void bulkCases()
+    {
+        int size = options.size;
+        bench_input<int> in(size);
+        const vector<int>& values = in.values;
+        const int batch = 64 * 1024;
+
+        measureRuns<Deque<int> >("Deque", "push_back", sizeof(int), size, size,
+                                 [](Deque<int>&)
+                                 {
+                                 },
+                                 [&](Deque<int>& d)
+                                 {
+                                     for (int value : values)
+                                         d.push_back(value);
+                                     return (uint64_t)d.size();
+                                 });
+        measureRuns<Deque<int> >("Deque", "append_64k", sizeof(int), size, size,
+                                 [](Deque<int>&)
+                                 {
+                                 },
+                                 [&](Deque<int>& d)
+                                 {
+                                     for (int done = 0; done < size; done += batch)
+                                         d.append(values.data() + done, values.data() + min(size, done + batch));
+                                     return (uint64_t)d.size();
+                                 });
+
+        measureRuns<Deque<int> >("Deque", "sort_ring", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     sort(d.begin(), d.end());
+                                     return (uint64_t)d.front();
+                                 });
+        measureRuns<Deque<int> >("Deque", "linearize_sort", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     int* data = d.linearize();
+                                     sort(data, data + d.size());
+                                     return (uint64_t)data[0];
+                                 });
+
+        measureRuns<Deque<int> >("Deque", "scan_iterator", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     uint64_t sum = 0;
+                                     for (auto it = d.begin(); it != d.end(); ++it)
+                                         sum += *it;
+                                     return sum;
+                                 });
+        measureRuns<Deque<int> >("Deque", "scan_segmented", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     return (uint64_t)accumulate(d.begin(), d.end(), 0LL);
+                                 });
+        measureRuns<vector<int> >("std::vector", "scan_segmented", sizeof(int), size, size,
+                                  [&](vector<int>& v)
+                                  {
+                                      v = values;
+                                  },
+                                  [](vector<int>& v)
+                                  {
+                                      return (uint64_t)accumulate(v.begin(), v.end(), 0LL);
+                                  });
+
+        measureRuns<Deque<int> >("Deque", "stream_naive", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     stringstream stream;
+                                     for (int value : d)
+                                         stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+                                     Deque<int> loaded;
+                                     int value;
+                                     while (stream.read(reinterpret_cast<char*>(&value), sizeof(value)))
+                                         loaded.push_back(value);
+                                     return (uint64_t)loaded.size();
+                                 });
+        measureRuns<Deque<int> >("Deque", "save_load", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     stringstream stream;
+                                     save(d, stream);
+                                     Deque<int> loaded;
+                                     load(loaded, stream);
+                                     return (uint64_t)loaded.size();
+                                 });
+    }
+
+    void simdCases()
+    {
+        static const char* const isa_names[] = { "scalar", "sse2", "avx2" };
+        int size = options.size;
+        bench_input<int> in(size);
+        const int threshold = 1 << 30;
+
+        measureRuns<Deque<int> >("Deque", "count_greater", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, in.values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     uint64_t count = 0;
+                                     for (auto it = d.begin(); it != d.end(); ++it)
+                                         count += *it > threshold;
+                                     return count;
+                                 });
+        measureRuns<vector<int> >("std::vector", "count_greater", sizeof(int), size, size,
+                                  [&](vector<int>& v)
+                                  {
+                                      v = in.values;
+                                  },
+                                  [](vector<int>& v)
+                                  {
+                                      return (uint64_t)count_if(v.begin(), v.end(), [](int x) { return x > threshold; });
+                                  });
+
+        simd_isa detected = detected_simd_isa();
+        for (int isa = simd_scalar; isa <= detected; isa++)
+        {
+            active_simd_isa() = (simd_isa)isa;
+            string name = string("Deque+") + isa_names[isa];
+            measureRuns<Deque<int> >(name, "count_greater", sizeof(int), size, size,
+                                     [&](Deque<int>& d)
+                                     {
+                                         fillWrapped(d, in.values);
+                                     },
+                                     [](Deque<int>& d)
+                                     {
+                                         return (uint64_t)simd_count_greater(d, threshold);
+                                     });
+            measureRuns<Deque<int> >(name, "sum", sizeof(int), size, size,
+                                     [&](Deque<int>& d)
+                                     {
+                                         fillWrapped(d, in.values);
+                                     },
+                                     [](Deque<int>& d)
+                                     {
+                                         return (uint64_t)simd_sum(d);
+                                     });
+        }
+        active_simd_isa() = detected;
+    }
+
+    void windowCases()
+    {
+        int size = options.size;
+        const uint last_n = 1000;
+
+        measureTask("Deque", "last_1000", sizeof(int), size, size, [&]()
+        {
+            Deque<int> window;
+            fori(i, size)
+            {
+                if ((uint)window.size() == last_n)
+                    window.pop_front();
+                window.push_back(i);
+            }
+            return (uint64_t)window.front();
+        });
+        measureTask("CircularBuffer", "last_1000", sizeof(int), size, size, [&]()
+        {
+            CircularBuffer<int> window(last_n);
+            fori(i, size)
+                window.push_back(i);
+            return (uint64_t)window.front();
+        });
+
+        // The naive scan costs O(window) per element; keep it to a bounded stream.
+        int stream_size = min(size, 1 << 16);
+        const int width = 1000;
+        bench_input<int> in(stream_size);
+        const vector<int>& stream = in.values;
+        measureTask("Deque", "min_sum_naive", sizeof(int), stream_size, stream_size, [&]()
+        {
+            uint64_t check = 0;
+            Deque<int> values;
+            fori(i, stream_size)
+            {
+                values.push_back(stream[i]);
+                if (values.size() > width)
+                    values.pop_front();
+                check += *min_element(values.begin(), values.end());
+                check += accumulate(values.begin(), values.end(), 0LL);
+            }
+            return check;
+        });
+        measureTask("SlidingWindow", "min_sum", sizeof(int), stream_size, stream_size, [&]()
+        {
+            uint64_t check = 0;
+            MinWindow<int> min_window;
+            SumWindow<long long> sum_window;
+            fori(i, stream_size)
+            {
+                min_window.push(i, stream[i]);
+                sum_window.push(i, stream[i]);
+                min_window.evict_until(i - width + 1);
+                sum_window.evict_until(i - width + 1);
+                check += min_window.query();
+                check += sum_window.query();
+            }
+            return check;
+        });
+    }
+
+    void concurrencyCases()
+    {
+        int size = options.size;
+
+        measureTask("Deque+mutex", "handoff", sizeof(int), size, size, [&]()
+        {
+            Deque<int> locked_deque;
+            mutex lock;
+            thread producer([&]()
+            {
+                fori(i, size)
+                {
+                    lock_guard<mutex> guard(lock);
+                    locked_deque.push_back(i);
+                }
+            });
+            uint64_t sum = 0;
+            for (int received = 0; received < size;)
+            {
+                unique_lock<mutex> guard(lock);
+                if (!locked_deque.empty())
+                {
+                    sum += locked_deque.front();
+                    locked_deque.pop_front();
+                    received++;
+                }
+                else
+                {
+                    guard.unlock();
+                    this_thread::yield();
+                }
+            }
+            producer.join();
+            return sum;
+        });
+        measureTask("SpscDeque", "handoff", sizeof(int), size, size, [&]()
+        {
+            SpscDeque<int> queue(4096);
+            thread producer([&]()
+            {
+                fori(i, size)
+                    while (!queue.try_push(i))
+                        this_thread::yield();
+            });
+            uint64_t sum = 0;
+            for (int received = 0; received < size;)
+            {
+                int value;
+                if (queue.try_pop(value))
+                {
+                    sum += value;
+                    received++;
+                }
+                else
+                    this_thread::yield();
+            }
+            producer.join();
+            return sum;
+        });
+
+        for (int threads_count : threadCounts())
+        {
+            int per_thread = size / threads_count;
+            measureTask("MpmcQueue", "handoff_" + to_string(threads_count) + "x" + to_string(threads_count),
+                        sizeof(int), size, per_thread * threads_count, [&]()
+            {
+                MpmcQueue<int> queue(4096);
+                atomic<uint64_t> sum(0);
+                vector<thread> threads;
+                fori(t, threads_count)
+                {
+                    threads.push_back(thread([&queue, per_thread]()
+                    {
+                        fori(i, per_thread)
+                            queue.push(i);
+                    }));
+                    threads.push_back(thread([&queue, &sum, per_thread]()
+                    {
+                        uint64_t local = 0;
+                        fori(i, per_thread)
+                        {
+                            int value;
+                            queue.pop(value);
+                            local += value;
+                        }
+                        sum += local;
+                    }));
+                }
+                for (auto& th : threads)
+                    th.join();
+                return sum.load();
+            });
+        }
+
+        bench_input<int> in(size);
+        for (int threads_count : threadCounts())
+        {
+            ThreadPool pool(threads_count);
+            measureTask("ThreadPool", "recursive_sum_" + to_string(threads_count), sizeof(int), size, size, [&]()
+            {
+                uint64_t sum = 0;
+                TaskGroup group(pool);
+                group.run([&]() { sum = parallelSum(pool, in.values.data(), in.values.data() + size); });
+                group.wait();
+                return sum;
+            });
+        }
+
+        for (int batch = 1; batch <= 256; batch *= 16)
+        {
+            measureTask("BlockingDeque", "batch_" + to_string(batch), sizeof(int), size, size, [&]()
+            {
+                BlockingDeque<int> channel(1024);
+                uint64_t sum = 0;
+                thread consumer([&]()
+                {
+                    vector<int> values(batch);
+                    size_t n;
+                    while ((n = channel.pop_n(values.begin(), batch)) != 0)
+                        fori(j, n)
+                            sum += values[j];
+                });
+                vector<int> values(batch);
+                for (int i = 0; i < size; i += batch)
+                {
+                    int count = min(batch, size - i);
+                    fori(j, count)
+                        values[j] = i + j;
+                    channel.push_n(values.begin(), count);
+                }
+                channel.close();
+                consumer.join();
+                return sum;
+            });
+        }
+
+        measureRuns<Deque<int> >("Deque", "sort", sizeof(int), size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, in.values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     sort(d.begin(), d.end());
+                                     return (uint64_t)d.front();
+                                 });
+        measureRuns<Deque<int> >("Deque", "parallel_sort_" + to_string(default_thread_pool().size()), sizeof(int),
+                                 size, size,
+                                 [&](Deque<int>& d)
+                                 {
+                                     fillWrapped(d, in.values);
+                                 },
+                                 [](Deque<int>& d)
+                                 {
+                                     parallel_sort(d.begin(), d.end());
+                                     return (uint64_t)d.front();
+                                 });
+
+        const int rounds = 10 * 1000;
+        measureTask("BlockingDeque", "round_trip", sizeof(int), rounds, rounds, [&]()
+        {
+            BlockingDeque<int> ping(1), pong(1);
+            thread echo([&]()
+            {
+                int value;
+                while (ping.pop(value))
+                    pong.push(value);
+            });
+            uint64_t sum = 0;
+            fori(i, rounds)
+            {
+                int value = 0;
+                ping.push(i);
+                pong.pop(value);
+                sum += value;
+            }
+            ping.close();
+            echo.join();
+            return sum;
+        });
+    }
+
+    void writeTable(ostream& out) const
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "%-14s %5s %-18s %9s %12s %12s %12s %12s %10s\n",
+                 "container", "bytes", "workload", "size", "min_ms", "p50_ms", "p90_ms", "max_ms", "ns/op");
+        out << line;
+        for (const bench_result& r : results)
+        {
+            snprintf(line, sizeof(line), "%-14s %5u %-18s %9d %12.3f %12.3f %12.3f %12.3f %10.2f\n",
+                     r.container.c_str(), (unsigned)r.element_size, r.workload.c_str(), r.size, r.min_ns / 1e6,
+                     r.p50_ns / 1e6, r.p90_ns / 1e6, r.max_ns / 1e6, r.p50_ns / r.ops);
+            out << line;
+        }
+    }
+
+    void writeCsv(ostream& out) const
+    {
+        out << "container,element_size,workload,size,reps,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,ns_per_op\n";
+        for (const bench_result& r : results)
+            out << r.container << ',' << r.element_size << ',' << r.workload << ',' << r.size << ','
+                << r.reps << ',' << r.min_ns << ',' << r.p50_ns << ',' << r.p90_ns << ',' << r.p99_ns << ','
+                << r.max_ns << ',' << r.mean_ns << ',' << r.p50_ns / r.ops << '\n';
+    }
+
+    void writeJson(ostream& out) const
+    {
+        out << "{\n  \"suite\": \"" << options.suite << "\",\n  \"reps\": " << options.reps
+            << ",\n  \"warmup\": " << options.warmup << ",\n  \"results\": [\n";
+        fori(i, results.size())
+        {
+            const bench_result& r = results[i];
+            out << "    {\"container\": \"" << r.container << "\", \"element_size\": " << r.element_size
+                << ", \"workload\": \"" << r.workload << "\", \"size\": " << r.size << ", \"min_ns\": " << r.min_ns
+                << ", \"p50_ns\": " << r.p50_ns << ", \"p90_ns\": " << r.p90_ns << ", \"p99_ns\": " << r.p99_ns
+                << ", \"max_ns\": " << r.max_ns << ", \"mean_ns\": " << r.mean_ns
+                << ", \"ns_per_op\": " << r.p50_ns / r.ops << "}" << (i + 1 < (int)results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    bool selected(const string& suite) const
+    {
+        return options.suite == "all" || options.suite == suite;
+    }
+
+public:
+
+    explicit Benchmark(const bench_options & user_options)
+        : options(user_options)
+    {
+    }
+
+    void run()
+    {
+        if (selected("containers"))
+        {
+            elementCases<int>();
+            elementCases<payload<16> >();
+            elementCases<payload<64> >();
+        }
+        if (selected("growth"))
+            growthCases();
+        if (selected("bulk"))
+            bulkCases();
+        if (selected("simd"))
+            simdCases();
+        if (selected("window"))
+            windowCases();
+        if (selected("concurrency"))
+            concurrencyCases();
+    }
+
+    void report(ostream& out) const
+    {
+        out.setf(ios::fixed);
+        out.precision(2);
+        if (options.format == "csv")
+            writeCsv(out);
+        else if (options.format == "json")
+            writeJson(out);
+        else
+            writeTable(out);
+    }
+};
+
+bool parseOption(const string& arg, const string& name, string& value)
+{
+    string prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options options;
+    fori(i, argc - 1)
+    {
+        string arg = argv[i + 1], value;
+        if (parseOption(arg, "size", value))
+            options.size = max(stoi(value), 1);
+        else if (parseOption(arg, "reps", value))
+            options.reps = max(stoi(value), 1);
+        else if (parseOption(arg, "warmup", value))
+            options.warmup = max(stoi(value), 0);
+        else if (parseOption(arg, "suite", value) &&
+                 find(begin(bench_suites), end(bench_suites), value) != end(bench_suites))
+            options.suite = value;
+        else if (parseOption(arg, "filter", value))
+            options.filter = value;
+        else if (parseOption(arg, "format", value))
+            options.format = value;
+        else if (parseOption(arg, "out", value))
+            options.out = value;
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--suite=containers|growth|bulk|simd|window|concurrency|all]"
+                 << " [--size=N] [--reps=N] [--warmup=N] [--filter=substr] [--format=table|csv|json]"
+                 << " [--out=path]" << endl;
+            return 1;
+        }
+    }
+
+    Benchmark benchmark(options);
+    benchmark.run();
+    if (options.out.empty())
+        benchmark.report(cout);
+    else
+    {
+        ofstream out(options.out);
+        benchmark.report(out);
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+
+/*
+ * Bounded blocking FIFO channel over Deque. Producers wait while the channel
+ * is full, consumers wait while it is empty; after close() pushes fail and
+ * pops drain what is left, then fail.
+ *
+ * Wakeups are coalesced: a side is only notified when the channel leaves the
+ * state it waits on (empty or full) and someone is actually waiting, so a burst
+ * of pushes into a non-empty channel costs no notify at all. A woken waiter
+ * passes the wakeup on if there is still work left for the next one.
+ * push_n/pop_n move whole batches under a single lock acquisition.
+ */
+template <typename T> class BlockingDeque
+{
+    mutable mutex lock;
+    condition_variable not_empty, not_full;
+    Deque<T> items;
+    size_t capacity;
+    uint waiting_consumers, waiting_producers;
+    bool closed;
+
+    typedef unique_lock<mutex> guard_type;
+
+    bool isFull() const
+    {
+        return (size_t)items.size() >= capacity;
+    }
+
+    template <typename Predicate, typename Clock, typename Duration>
+    static bool waitUntil(guard_type& guard, condition_variable& cond, uint& waiting,
+                          Predicate ready, const chrono::time_point<Clock, Duration>* deadline)
+    {
+        if (ready())
+            return true;
+        waiting++;
+        bool result = true;
+        if (deadline == nullptr)
+            cond.wait(guard, ready);
+        else
+            result = cond.wait_until(guard, *deadline, ready);
+        waiting--;
+        return result;
+    }
+
+    void notifyAfterPush(guard_type& guard, bool was_empty)
+    {
+        bool wake = was_empty && waiting_consumers != 0;
+        bool pass_on = !isFull() && waiting_producers != 0;
+        guard.unlock();
+        if (wake)
+            not_empty.notify_one();
+        if (pass_on)
+            not_full.notify_one();
+    }
+
+    void notifyAfterPop(guard_type& guard, bool was_full)
+    {
+        bool wake = was_full && waiting_producers != 0;
+        bool pass_on = !items.empty() && waiting_consumers != 0;
+        guard.unlock();
+        if (wake)
+            not_full.notify_one();
+        if (pass_on)
+            not_empty.notify_one();
+    }
+
+    template <typename U, typename Clock, typename Duration>
+    bool pushImpl(U&& obj, const chrono::time_point<Clock, Duration>* deadline, bool may_wait)
+    {
+        guard_type guard(lock);
+        auto ready = [this]() { return closed || !isFull(); };
+        if (may_wait ? !waitUntil(guard, not_full, waiting_producers, ready, deadline) : !ready())
+            return false;
+        if (closed)
+            return false;
+        bool was_empty = items.empty();
+        items.push_back(forward<U>(obj));
+        notifyAfterPush(guard, was_empty);
+        return true;
+    }
+
+    template <typename Clock, typename Duration>
+    bool popImpl(T& obj, const chrono::time_point<Clock, Duration>* deadline, bool may_wait)
+    {
+        guard_type guard(lock);
+        auto ready = [this]() { return closed || !items.empty(); };
+        if (may_wait ? !waitUntil(guard, not_empty, waiting_consumers, ready, deadline) : !ready())
+            return false;
+        if (items.empty())
+            return false;
+        bool was_full = isFull();
+        obj = move(items[0]);
+        items.pop_front();
+        notifyAfterPop(guard, was_full);
+        return true;
+    }
+
+    typedef chrono::steady_clock::time_point no_deadline;
+
+public:
+
+    explicit BlockingDeque(size_t user_capacity = numeric_limits<size_t>::max())
+        : capacity(max<size_t>(user_capacity, 1)), waiting_consumers(0), waiting_producers(0), closed(false)
+    {
+        if (capacity <= 1024)
+            items.reserve((uint)capacity);
+    }
+
+    BlockingDeque(const BlockingDeque &) = delete;
+    BlockingDeque& operator = (const BlockingDeque &) = delete;
+
+    bool push(const T& obj)
+    {
+        return pushImpl(obj, (const no_deadline*)nullptr, true);
+    }
+
+    bool push(T&& obj)
+    {
+        return pushImpl(move(obj), (const no_deadline*)nullptr, true);
+    }
+
+    bool try_push(const T& obj)
+    {
+        return pushImpl(obj, (const no_deadline*)nullptr, false);
+    }
+
+    bool try_push(T&& obj)
+    {
+        return pushImpl(move(obj), (const no_deadline*)nullptr, false);
+    }
+
+    template <typename Rep, typename Period>
+    bool push_for(const T& obj, const chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = chrono::steady_clock::now() + timeout;
+        return pushImpl(obj, &deadline, true);
+    }
+
+    template <typename Rep, typename Period>
+    bool push_for(T&& obj, const chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = chrono::steady_clock::now() + timeout;
+        return pushImpl(move(obj), &deadline, true);
+    }
+
+    bool pop(T& obj)
+    {
+        return popImpl(obj, (const no_deadline*)nullptr, true);
+    }
+
+    bool try_pop(T& obj)
+    {
+        return popImpl(obj, (const no_deadline*)nullptr, false);
+    }
+
+    template <typename Rep, typename Period>
+    bool pop_for(T& obj, const chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = chrono::steady_clock::now() + timeout;
+        return popImpl(obj, &deadline, true);
+    }
+
+    /*
+     * Moves count elements in, waiting for room as needed; every chunk that
+     * fits is appended under one lock acquisition. Returns how many were
+     * pushed, which is less than count only if the channel was closed.
+     */
+    template <typename InputIt> size_t push_n(InputIt first, size_t count)
+    {
+        size_t pushed = 0;
+        while (pushed < count)
+        {
+            guard_type guard(lock);
+            waitUntil(guard, not_full, waiting_producers, [this]() { return closed || !isFull(); },
+                      (const no_deadline*)nullptr);
+            if (closed)
+                break;
+            bool was_empty = items.empty();
+            size_t n = min(count - pushed, capacity - (size_t)items.size());
+            for (size_t i = 0; i < n; i++, ++first)
+                items.push_back(move(*first));
+            pushed += n;
+            notifyAfterPush(guard, was_empty);
+        }
+        return pushed;
+    }
+
+    /*
+     * Waits until at least one element is available and moves out up to
+     * max_count of them under one lock acquisition. Returns 0 only once the
+     * channel is closed and drained.
+     */
+    template <typename OutputIt> size_t pop_n(OutputIt out, size_t max_count)
+    {
+        guard_type guard(lock);
+        waitUntil(guard, not_empty, waiting_consumers, [this]() { return closed || !items.empty(); },
+                  (const no_deadline*)nullptr);
+        bool was_full = isFull();
+        size_t n = min(max_count, (size_t)items.size());
+        for (size_t i = 0; i < n; i++, ++out)
+        {
+            *out = move(items[0]);
+            items.pop_front();
+        }
+        if (n != 0)
+            notifyAfterPop(guard, was_full);
+        return n;
+    }
+
+    void close()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    bool is_closed() const
+    {
+        lock_guard<mutex> guard(lock);
+        return closed;
+    }
+
+    size_t size() const
+    {
+        lock_guard<mutex> guard(lock);
+        return (size_t)items.size();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t get_capacity() const
+    {
+        return capacity;
+    }
+};
@@ -0,0 +1,327 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+
+/*
+ * Fixed-capacity ring keeping the last max_size() elements. The storage is
+ * allocated once, in the constructor, as the smallest power of two holding the
+ * requested capacity, so indexing is the same masked arithmetic as in Deque
+ * and it uses the same container_iterator. Pushing into a full buffer
+ * overwrites the element at the opposite end in O(1); nothing is ever
+ * reallocated.
+ */
+template <typename T, typename Allocator = allocator<T> > class CircularBuffer
+{
+    typedef allocator_traits<Allocator> alloc_traits;
+
+    Allocator alloc;
+    T* buf;
+    uint ring, limit;
+    uint head, count;
+
+    T& getAt(uint index) const
+    {
+        return buf[(head + index) & (ring - 1)];
+    }
+
+    void allocate(uint user_capacity)
+    {
+        limit = max(user_capacity, 1u);
+        ring = 1;
+        while (ring < limit)
+            ring <<= 1;
+        buf = alloc_traits::allocate(alloc, ring);
+        head = count = 0;
+    }
+
+    void destroyElements()
+    {
+        if (!is_trivially_destructible<T>::value)
+            for (uint i = 0; i < count; i++)
+                alloc_traits::destroy(alloc, &getAt(i));
+        head = count = 0;
+    }
+
+    void release()
+    {
+        destroyElements();
+        if (buf != nullptr)
+            alloc_traits::deallocate(alloc, buf, ring);
+        buf = nullptr;
+    }
+
+    void copyFrom(const CircularBuffer & obj)
+    {
+        allocate(obj.limit);
+        for (uint i = 0; i < obj.count; i++)
+            alloc_traits::construct(alloc, buf + i, obj.getAt(i));
+        count = obj.count;
+    }
+
+    void stealFrom(CircularBuffer & obj)
+    {
+        buf = obj.buf;
+        ring = obj.ring;
+        limit = obj.limit;
+        head = obj.head;
+        count = obj.count;
+        obj.buf = nullptr;
+        obj.ring = 0;
+        obj.head = obj.count = 0;
+    }
+
+    // A moved-from buffer keeps its max_size() and allocates again on its next push.
+    void ensureStorage()
+    {
+        if (buf == nullptr)
+            allocate(limit);
+    }
+
+public:
+
+    typedef Allocator                   allocator_type;
+    typedef container_iterator<T>       iterator;
+    typedef container_iterator<const T> const_iterator;
+
+    typedef std::reverse_iterator<iterator>       reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    explicit CircularBuffer(uint user_capacity, const Allocator & user_alloc = Allocator())
+        : alloc(user_alloc)
+    {
+        allocate(user_capacity);
+    }
+
+    CircularBuffer(const CircularBuffer & obj)
+        : alloc(alloc_traits::select_on_container_copy_construction(obj.alloc))
+    {
+        copyFrom(obj);
+    }
+
+    CircularBuffer(CircularBuffer && obj)
+        : alloc(move(obj.alloc))
+    {
+        stealFrom(obj);
+    }
+
+    CircularBuffer& operator = (const CircularBuffer & obj)
+    {
+        if (this == &obj)
+            return *this;
+        release();
+        copyFrom(obj);
+        return *this;
+    }
+
+    CircularBuffer& operator = (CircularBuffer && obj)
+    {
+        if (this == &obj)
+            return *this;
+        release();
+        if (alloc_traits::propagate_on_container_move_assignment::value)
+            alloc = move(obj.alloc);
+        if (alloc == obj.alloc)
+            stealFrom(obj);
+        else
+        {
+            copyFrom(obj);
+            obj.clear();
+        }
+        return *this;
+    }
+
+    allocator_type get_allocator() const
+    {
+        return alloc;
+    }
+
+    uint size() const
+    {
+        return count;
+    }
+
+    uint max_size() const
+    {
+        return limit;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    bool full() const
+    {
+        return count == limit;
+    }
+
+    void clear()
+    {
+        destroyElements();
+    }
+
+    // Appends obj; when the buffer is full the front (oldest) element is overwritten.
+    template <typename... Args> T& emplace_back(Args&&... args)
+    {
+        ensureStorage();
+        if (count == limit)
+        {
+            T value(forward<Args>(args)...);
+            pop_front();
+            return emplace_back(move(value));
+        }
+        T& slot = getAt(count);
+        alloc_traits::construct(alloc, &slot, forward<Args>(args)...);
+        count++;
+        return slot;
+    }
+
+    // Prepends obj; when the buffer is full the back (newest) element is overwritten.
+    template <typename... Args> T& emplace_front(Args&&... args)
+    {
+        ensureStorage();
+        if (count == limit)
+        {
+            T value(forward<Args>(args)...);
+            pop_back();
+            return emplace_front(move(value));
+        }
+        head = (head - 1) & (ring - 1);
+        T& slot = buf[head];
+        alloc_traits::construct(alloc, &slot, forward<Args>(args)...);
+        count++;
+        return slot;
+    }
+
+    void push_back(const T& obj)
+    {
+        emplace_back(obj);
+    }
+
+    void push_back(T&& obj)
+    {
+        emplace_back(move(obj));
+    }
+
+    void push_front(const T& obj)
+    {
+        emplace_front(obj);
+    }
+
+    void push_front(T&& obj)
+    {
+        emplace_front(move(obj));
+    }
+
+    void pop_back()
+    {
+        if (count == 0)
+            throw new exception();
+        alloc_traits::destroy(alloc, &getAt(count - 1));
+        count--;
+    }
+
+    void pop_front()
+    {
+        if (count == 0)
+            throw new exception();
+        alloc_traits::destroy(alloc, &getAt(0));
+        head = (head + 1) & (ring - 1);
+        count--;
+    }
+
+    T& front()
+    {
+        return operator[](0);
+    }
+
+    const T& front() const
+    {
+        return operator[](0);
+    }
+
+    T& back()
+    {
+        return operator[](count - 1);
+    }
+
+    const T& back() const
+    {
+        return operator[](count - 1);
+    }
+
+    T& operator[] (int index)
+    {
+        if (index < 0 || index >= (int)count)
+            throw new exception();
+        return getAt(index);
+    }
+
+    const T& operator[] (int index) const
+    {
+        if (index < 0 || index >= (int)count)
+            throw new exception();
+        return getAt(index);
+    }
+
+    pair<ring_span<T>, ring_span<T> > as_spans()
+    {
+        return begin().spans_to(end());
+    }
+
+    pair<ring_span<const T>, ring_span<const T> > as_spans() const
+    {
+        return begin().spans_to(end());
+    }
+
+    iterator begin()
+    {
+        return iterator(buf, head, ring, 0);
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(buf, head, ring, 0);
+    }
+    iterator end()
+    {
+        return iterator(buf, head, ring, count);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(buf, head, ring, count);
+    }
+
+    const_iterator cbegin() const
+    {
+        return begin();
+    }
+    const_iterator cend() const
+    {
+        return end();
+    }
+
+    reverse_iterator rbegin()
+    {
+        return reverse_iterator(end());
+    }
+    const_reverse_iterator rbegin() const
+    {
+        return const_reverse_iterator(end());
+    }
+    reverse_iterator rend()
+    {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rend() const
+    {
+        return const_reverse_iterator(begin());
+    }
+
+    ~CircularBuffer()
+    {
+        release();
+    }
+};
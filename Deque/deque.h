@@ -3,150 +3,402 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 const uint base_capacity = 8;
-template <typename T> class Deque;
 
-template <typename IteratorType> class container_iterator :
-    public iterator<random_access_iterator_tag, IteratorType>
+/*
+ * Compile-time growth policy. Capacity is multiplied by 2^GrowthShift when the
+ * ring fills up. Once size drops to capacity / ShrinkDivisor (0 disables
+ * shrinking) the ring is reallocated to the smallest power of two holding
+ * size * Hysteresis elements, but never below MinCapacity.
+ */
+template <uint GrowthShift = 1, uint ShrinkDivisor = 4, uint Hysteresis = 2, uint MinCapacity = base_capacity>
+struct growth_policy
 {
-private:
+    static_assert(GrowthShift > 0, "capacity must grow");
+    static_assert(MinCapacity > 0 && (MinCapacity & (MinCapacity - 1)) == 0, "capacity must be a power of two");
 
-    IteratorType* ptr;
-    int cur, size, pos;
+    uint min_capacity() const
+    {
+        return MinCapacity;
+    }
 
-    void move_this(int tsize)
+    uint grow(uint capacity) const
     {
-        tsize -= (tsize / size) * size;
-        ptr += tsize;
-        cur += tsize;
-        pos += tsize;
-        while (cur >= size)
-        {
-            cur -= size;
-            ptr -= size;
-        }
-        while (cur < 0)
+        return capacity << GrowthShift;
+    }
+
+    bool should_shrink(uint size, uint capacity) const
+    {
+        return ShrinkDivisor != 0 && size * ShrinkDivisor <= capacity;
+    }
+
+    uint shrink(uint size) const
+    {
+        uint new_capacity = MinCapacity;
+        while (new_capacity < size * Hysteresis || new_capacity <= size)
+            new_capacity <<= 1;
+        return new_capacity;
+    }
+};
+
+/*
+ * Counters kept by an instrumented_policy. Reallocations are split into grows
+ * and shrinks; bytes_relocated counts the element bytes moved to the new
+ * buffers and resize_nanoseconds the wall time spent doing it.
+ */
+struct deque_stats
+{
+    uint64_t reallocations = 0, grows = 0, shrinks = 0;
+    uint64_t bytes_relocated = 0, resize_nanoseconds = 0;
+    uint64_t max_size = 0, max_capacity = 0;
+    uint64_t pushes_back = 0, pushes_front = 0, pops_back = 0, pops_front = 0;
+    uint64_t bounds_checks = 0;
+
+    void reset()
+    {
+        *this = deque_stats();
+    }
+
+    // Calls f(name, value) for every counter; meant for metrics exporters.
+    template <typename F> void for_each_counter(F f) const
+    {
+        f("reallocations", reallocations);
+        f("grows", grows);
+        f("shrinks", shrinks);
+        f("bytes_relocated", bytes_relocated);
+        f("resize_nanoseconds", resize_nanoseconds);
+        f("max_size", max_size);
+        f("max_capacity", max_capacity);
+        f("pushes_back", pushes_back);
+        f("pushes_front", pushes_front);
+        f("pops_back", pops_back);
+        f("pops_front", pops_front);
+        f("bounds_checks", bounds_checks);
+    }
+
+    void dump(ostream& out, const char* prefix = "deque.") const
+    {
+        for_each_counter([&](const char* name, uint64_t value)
         {
-            cur += size;
-            ptr += size;
-        }
+            out << prefix << name << '=' << value << '\n';
+        });
     }
+};
 
-public:
+/*
+ * Growth policy that behaves like Base and also keeps deque_stats, available
+ * through Deque::stats(). With any other policy Deque compiles the counting
+ * away; defining DEQUE_ENABLE_STATS makes this the default policy. The
+ * counters are copied and moved along with the policy.
+ */
+template <typename Base = growth_policy<> > struct instrumented_policy : public Base
+{
+    mutable deque_stats counters;
 
-    container_iterator(IteratorType* n_ptr, uint pos_in_array, uint capacity, uint pos_in_container)
-        : ptr(n_ptr), cur(pos_in_array), size(capacity), pos(pos_in_container)
+    const deque_stats& stats() const
     {
+        return counters;
     }
 
-    container_iterator(const container_iterator &it)
+    void reset_stats()
     {
-        ptr = it.ptr;
-        cur = it.cur;
-        size = it.size;
-        pos = it.pos;
+        counters.reset();
     }
+};
 
-    container_iterator(const container_iterator && it)
+template <typename Policy> struct policy_stats
+{
+    static deque_stats* get(const Policy &)
     {
-        ptr = it.ptr;
-        cur = it.cur;
-        size = it.size;
-        pos = it.pos;
+        return nullptr;
     }
+};
 
-    container_iterator& operator = (const container_iterator& it)
+template <typename Base> struct policy_stats<instrumented_policy<Base> >
+{
+    static deque_stats* get(const instrumented_policy<Base> & policy)
     {
-        cur = it.cur;
-        size = it.size;
-        ptr = it.ptr;
-        pos = it.pos;
-        return *this;
+        return &policy.counters;
     }
+};
+
+#ifdef DEQUE_ENABLE_STATS
+typedef instrumented_policy<growth_policy<> > default_growth_policy;
+#else
+typedef growth_policy<> default_growth_policy;
+#endif
 
-    IteratorType& operator *()
+/*
+ * The same knobs as growth_policy, adjustable at run time through
+ * Deque::get_growth_policy().
+ */
+struct runtime_growth_policy
+{
+    uint growth_shift, shrink_divisor, hysteresis, minimal_capacity;
+
+    runtime_growth_policy()
+        : growth_shift(1), shrink_divisor(4), hysteresis(2), minimal_capacity(base_capacity)
     {
-        return *ptr;
     }
 
-    const IteratorType& operator *() const
+    uint min_capacity() const
     {
-        return *ptr;
+        return minimal_capacity;
+    }
+
+    uint grow(uint capacity) const
+    {
+        return capacity << growth_shift;
+    }
+
+    bool should_shrink(uint size, uint capacity) const
+    {
+        return shrink_divisor != 0 && size * shrink_divisor <= capacity;
+    }
+
+    uint shrink(uint size) const
+    {
+        uint new_capacity = minimal_capacity;
+        while (new_capacity < size * hysteresis || new_capacity <= size)
+            new_capacity <<= 1;
+        return new_capacity;
+    }
+};
+
+/*
+ * Types whose objects may be moved to another address with memcpy, leaving
+ * nothing to destroy at the old one. Defaults to trivially copyable types;
+ * specialize it for types that are relocatable without being trivially
+ * copyable (for example ones holding a unique_ptr).
+ */
+template <typename T> struct deque_trivially_relocatable : is_trivially_copyable<T>
+{
+};
+
+/*
+ * Allocators that can resize a buffer keeping its contents (see
+ * mremap_allocator) declare typedef true_type supports_grow_in_place and
+ * provide T* grow_in_place(T* ptr, size_t old_n, size_t new_n), which returns
+ * nullptr when it cannot.
+ */
+template <typename Allocator, typename = void> struct allocator_grows_in_place : false_type
+{
+};
+
+template <typename Allocator>
+struct allocator_grows_in_place<Allocator, void_t<typename Allocator::supports_grow_in_place> > :
+    Allocator::supports_grow_in_place
+{
+};
+
+template <uint N, uint Slots = 1, bool Done = (Slots > N)> struct inline_slots
+{
+    static const uint value = inline_slots<N, Slots * 2>::value;
+};
+
+template <uint N, uint Slots> struct inline_slots<N, Slots, true>
+{
+    static const uint value = Slots;
+};
+
+template <> struct inline_slots<0, 1, true>
+{
+    static const uint value = 0;
+};
+
+template <typename T, uint Slots> class inline_buffer
+{
+    typename aligned_storage<sizeof(T) * Slots, alignof(T)>::type storage;
+
+protected:
+
+    T* inlineData()
+    {
+        return reinterpret_cast<T*>(&storage);
+    }
+};
+
+template <typename T> class inline_buffer<T, 0>
+{
+protected:
+
+    T* inlineData()
+    {
+        return nullptr;
+    }
+};
+
+template <typename T, typename Allocator = allocator<T>, typename GrowthPolicy = default_growth_policy,
+          uint InlineCapacity = 0> class Deque;
+
+/*
+ * Deque keeping up to N elements inside the object (in the smallest power of
+ * two ring larger than N) and spilling to the heap only when it overflows.
+ */
+template <typename T, uint N, typename Allocator = allocator<T> >
+using SmallDeque = Deque<T, Allocator, default_growth_policy, N>;
+
+template <typename T> struct ring_span
+{
+    T* ptr;
+    uint count;
+
+    ring_span(T* n_ptr, uint n_count)
+        : ptr(n_ptr), count(n_count)
+    {
+    }
+
+    T* data() const
+    {
+        return ptr;
+    }
+    uint size() const
+    {
+        return count;
+    }
+    bool empty() const
+    {
+        return count == 0;
+    }
+    T* begin() const
+    {
+        return ptr;
+    }
+    T* end() const
+    {
+        return ptr + count;
+    }
+    T& operator[] (uint index) const
+    {
+        return ptr[index];
+    }
+};
+
+template <typename IteratorType> class container_iterator
+{
+private:
+
+    template <typename OtherType> friend class container_iterator;
+
+    IteratorType* buf;
+    uint mask, head;
+    int pos;
+
+public:
+
+    typedef random_access_iterator_tag                   iterator_category;
+    typedef typename remove_const<IteratorType>::type    value_type;
+    typedef ptrdiff_t                                    difference_type;
+    typedef IteratorType*                                pointer;
+    typedef IteratorType&                                reference;
+
+    container_iterator(IteratorType* n_buf, uint n_head, uint capacity, int pos_in_container)
+        : buf(n_buf), mask(capacity - 1), head(n_head), pos(pos_in_container)
+    {
+    }
+
+    template <typename OtherType>
+    container_iterator(const container_iterator<OtherType> &it,
+                       typename enable_if<is_convertible<OtherType*, IteratorType*>::value>::type* = nullptr)
+        : buf(it.buf), mask(it.mask), head(it.head), pos(it.pos)
+    {
+    }
+
+    pair<ring_span<IteratorType>, ring_span<IteratorType> > spans_to(const container_iterator &last) const
+    {
+        uint count = last.pos - pos;
+        uint start = (head + pos) & mask;
+        uint first_part = min(count, mask + 1 - start);
+        return make_pair(ring_span<IteratorType>(buf + start, first_part),
+                         ring_span<IteratorType>(buf, count - first_part));
+    }
+
+    IteratorType& operator *() const
+    {
+        return buf[(head + pos) & mask];
+    }
+
+    IteratorType* operator ->() const
+    {
+        return &buf[(head + pos) & mask];
     }
 
     container_iterator operator++(int)
     {
         container_iterator new_it(*this);
-        move_this(1);
+        pos++;
         return new_it;
     }
 
     container_iterator& operator++()
     {
-        move_this(1);
+        pos++;
         return *this;
     }
 
     container_iterator& operator -- ()
     {
-        move_this(-1);
+        pos--;
         return *this;
     }
 
     container_iterator operator -- (int)
     {
         container_iterator new_it(*this);
-        move_this(-1);
+        pos--;
         return new_it;
     }
 
     container_iterator operator + (int f) const
     {
         container_iterator new_it(*this);
-        new_it.move_this(f);
+        new_it.pos += f;
         return new_it;
     }
 
     container_iterator operator - (int f) const
     {
         container_iterator new_it(*this);
-        new_it.move_this(-f);
+        new_it.pos -= f;
         return new_it;
     }
 
-    int operator - (const container_iterator& it)
+    int operator - (const container_iterator& it) const
     {
         return pos - it.pos;
     }
 
     container_iterator& operator += (int f)
     {
-        move_this(f);
+        pos += f;
         return *this;
     }
 
     container_iterator& operator -= (int f)
     {
-        move_this(-f);
+        pos -= f;
         return *this;
     }
 
-    IteratorType& operator [] (int f)
+    IteratorType& operator [] (int f) const
     {
-        container_iterator new_q(*this);
-        new_q += f;
-        return *new_q;
+        return buf[(head + pos + f) & mask];
     }
 
     bool operator != (const container_iterator &it) const
     {
-        return ptr != it.ptr;
+        return pos != it.pos;
     }
 
     bool operator == (const container_iterator &it) const
     {
-        return ptr == it.ptr;
+        return pos == it.pos;
     }
 
     bool operator < (const container_iterator &it) const
@@ -161,127 +413,502 @@ public:
 
     bool operator >= (const container_iterator &it) const
     {
-        return (*this > it || *this == it);
+        return pos >= it.pos;
     }
 
     bool operator <= (const container_iterator &it) const
     {
-        return (*this < it || *this == it);
-    }
-
-    ~container_iterator()
-    {
-
+        return pos <= it.pos;
     }
 };
 
-template <typename T> class Deque
+template <typename IteratorType>
+container_iterator<IteratorType> operator + (int f, const container_iterator<IteratorType> &it)
 {
-    unique_ptr<T[]> buf;
+    return it + f;
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity> class Deque :
+    private inline_buffer<T, inline_slots<InlineCapacity>::value>
+{
+    typedef allocator_traits<Allocator> alloc_traits;
+
+    static const uint inline_capacity = inline_slots<InlineCapacity>::value;
+
+    Allocator alloc;
+    GrowthPolicy policy;
+    T* buf = nullptr;
     uint capacity, tail, head;
+    uint reserved;
 
     inline uint nextHead() const
     {
-        return (head - 1 + capacity) % capacity;
+        return (head - 1) & (capacity - 1);
     }
     inline uint nextTail() const
     {
-        return (tail + 1) % capacity;
+        return (tail + 1) & (capacity - 1);
     }
     inline uint prevHead() const
     {
-        return (head + 1) % capacity;
+        return (head + 1) & (capacity - 1);
     }
     inline uint prevTail() const
     {
-        return (tail - 1 + capacity) % capacity;
+        return (tail - 1) & (capacity - 1);
     }
 
-    T& getAt(int index)
+    T& getAt(int index) const
     {
-        return buf[(head + index) % capacity];
+        return buf[(head + index) & (capacity - 1)];
     }
 
-    void extendCapacity()
+    deque_stats* statsSink() const
+    {
+        return policy_stats<GrowthPolicy>::get(policy);
+    }
+
+    void notePush(uint64_t deque_stats::* counter, uint count)
+    {
+        if (deque_stats* stats = statsSink())
+        {
+            stats->*counter += count;
+            stats->max_size = max<uint64_t>(stats->max_size, size());
+            stats->max_capacity = max<uint64_t>(stats->max_capacity, capacity);
+        }
+    }
+
+    void notePop(uint64_t deque_stats::* counter)
+    {
+        if (deque_stats* stats = statsSink())
+            stats->*counter += 1;
+    }
+
+    bool isInline(const T* ptr)
+    {
+        return inline_capacity != 0 && ptr == this->inlineData();
+    }
+
+    uint minCapacity() const
+    {
+        return inline_capacity != 0 ? inline_capacity : policy.min_capacity();
+    }
+
+    T* allocateBuffer(uint n)
+    {
+        if (n <= inline_capacity && !isInline(buf))
+            return this->inlineData();
+        return alloc_traits::allocate(alloc, n);
+    }
+
+    void releaseBuffer(T* ptr, uint n)
+    {
+        if (ptr != nullptr && !isInline(ptr))
+            alloc_traits::deallocate(alloc, ptr, n);
+    }
+
+    void destroyElements(uint count)
+    {
+        if (is_trivially_destructible<T>::value)
+            return;
+        for (uint i = 0; i < count; i++)
+            alloc_traits::destroy(alloc, &getAt(i));
+    }
+
+    void releaseStorage()
+    {
+        destroyElements(size());
+        releaseBuffer(buf, capacity);
+        buf = nullptr;
+        capacity = 0;
+        head = tail = 0;
+    }
+
+    void relocateTo(T* dst, uint count)
+    {
+        if (count == 0)
+            return;
+        if (is_trivially_copyable<T>::value)
+        {
+            uint first_part = min(count, capacity - head);
+            memcpy(static_cast<void*>(dst), buf + head, first_part * sizeof(T));
+            memcpy(static_cast<void*>(dst + first_part), buf, (count - first_part) * sizeof(T));
+            return;
+        }
+        for (uint i = 0; i < count; i++)
+        {
+            T& src = getAt(i);
+            alloc_traits::construct(alloc, dst + i, move_if_noexcept(src));
+            alloc_traits::destroy(alloc, &src);
+        }
+    }
+
+    void shiftDown(uint dst, uint src, uint count)
+    {
+        if (dst == src || count == 0)
+            return;
+        if (is_trivially_copyable<T>::value)
+        {
+            memmove(static_cast<void*>(buf + dst), buf + src, count * sizeof(T));
+            return;
+        }
+        for (uint i = 0; i < count; i++)
+        {
+            alloc_traits::construct(alloc, buf + dst + i, move_if_noexcept(buf[src + i]));
+            alloc_traits::destroy(alloc, buf + src + i);
+        }
+    }
+
+    /*
+     * memmove of count trivially copyable elements between ring positions,
+     * split where either range wraps. Moving toward the head copies front to
+     * back and moving toward the tail back to front, so overlapping shifts are
+     * safe.
+     */
+    void moveTowardHead(uint dst, uint src, uint count)
+    {
+        while (count != 0)
+        {
+            uint n = min(count, min(capacity - src, capacity - dst));
+            memmove(static_cast<void*>(buf + dst), buf + src, n * sizeof(T));
+            src = (src + n) & (capacity - 1);
+            dst = (dst + n) & (capacity - 1);
+            count -= n;
+        }
+    }
+
+    void moveTowardTail(uint dst, uint src, uint count)
+    {
+        uint src_end = (src + count) & (capacity - 1), dst_end = (dst + count) & (capacity - 1);
+        while (count != 0)
+        {
+            uint n = min(count, min(src_end == 0 ? capacity : src_end, dst_end == 0 ? capacity : dst_end));
+            src_end = (src_end - n) & (capacity - 1);
+            dst_end = (dst_end - n) & (capacity - 1);
+            memmove(static_cast<void*>(buf + dst_end), buf + src_end, n * sizeof(T));
+            count -= n;
+        }
+    }
+
+    void destroyRange(uint first, uint last)
+    {
+        if (is_trivially_destructible<T>::value)
+            return;
+        for (uint i = first; i < last; i++)
+            alloc_traits::destroy(alloc, &getAt(i));
+    }
+
+    void reallocate(uint new_capacity, uint count)
     {
-        uint new_capacity = capacity << 1;
-        unique_ptr<T[]> tmp = unique_ptr<T[]>(new T[new_capacity]);
-        for (uint i = 0; i < capacity; i++)
-            tmp[i] = getAt(i);
-        buf.swap(tmp);
+        deque_stats* stats = statsSink();
+        chrono::steady_clock::time_point start_time;
+        if (stats != nullptr)
+            start_time = chrono::steady_clock::now();
+
+        T* tmp = allocateBuffer(new_capacity);
+        relocateTo(tmp, count);
+        releaseBuffer(buf, capacity);
+        buf = tmp;
         head = 0;
-        tail = capacity;
+        tail = count;
+
+        if (stats != nullptr)
+            noteReallocation(stats, new_capacity, count, start_time);
+        capacity = new_capacity;
+    }
+
+    void noteReallocation(deque_stats* stats, uint new_capacity, uint relocated,
+                          chrono::steady_clock::time_point start_time)
+    {
+        stats->reallocations++;
+        (new_capacity > capacity ? stats->grows : stats->shrinks)++;
+        stats->bytes_relocated += (uint64_t)relocated * sizeof(T);
+        stats->resize_nanoseconds += chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start_time).count();
+        stats->max_capacity = max<uint64_t>(stats->max_capacity, new_capacity);
+    }
+
+    bool growInPlace(uint, false_type)
+    {
+        return false;
+    }
+
+    /*
+     * Grows the full ring without copying it: the allocator resizes the buffer
+     * (mremap for mremap_allocator) and only the shorter of the two runs is
+     * moved, the wrapped prefix [0, tail) up behind the old end or the run
+     * [head, capacity) to the end of the new buffer.
+     */
+    bool growInPlace(uint new_capacity, true_type)
+    {
+        if (!deque_trivially_relocatable<T>::value || isInline(buf))
+            return false;
+        deque_stats* stats = statsSink();
+        chrono::steady_clock::time_point start_time;
+        if (stats != nullptr)
+            start_time = chrono::steady_clock::now();
+
+        T* grown = alloc.grow_in_place(buf, capacity, new_capacity);
+        if (grown == nullptr)
+            return false;
+        buf = grown;
+        uint upper = capacity - head, wrapped = tail;
+        if (wrapped <= upper)
+        {
+            memcpy(static_cast<void*>(buf + capacity), buf, wrapped * sizeof(T));
+            tail = capacity + wrapped;
+        }
+        else
+        {
+            memcpy(static_cast<void*>(buf + new_capacity - upper), buf + head, upper * sizeof(T));
+            head = new_capacity - upper;
+        }
+
+        if (stats != nullptr)
+            noteReallocation(stats, new_capacity, min(wrapped, upper), start_time);
         capacity = new_capacity;
+        return true;
+    }
+
+    void extendCapacity()
+    {
+        uint new_capacity = policy.grow(capacity);
+        if (!growInPlace(new_capacity, allocator_grows_in_place<Allocator>()))
+            reallocate(new_capacity, capacity);
     }
     void compressCapacity()
     {
-        uint new_capacity = capacity >> 1;
-        unique_ptr<T[]> tmp = unique_ptr<T[]>(new T[new_capacity]);
         uint cur_size = size();
-        
-        for (uint i = 0; i < cur_size; i++)
-            tmp[i] = getAt(i);
-        buf.swap(tmp);
+        uint floor = max(reserved, minCapacity());
+        if (capacity <= floor || !policy.should_shrink(cur_size, capacity))
+            return;
+        uint new_capacity = max(policy.shrink(cur_size), floor);
+        if (new_capacity < capacity)
+            reallocate(new_capacity, cur_size);
+    }
+
+    void copyBuffer(const Deque & obj)
+    {
+        uint count = obj.size();
+        policy = obj.policy;
+        reserved = obj.reserved;
+        capacity = obj.capacity;
         head = 0;
-        tail = cur_size;
-        capacity = new_capacity;
+        tail = count;
+        buf = allocateBuffer(capacity);
+        for (uint i = 0; i < count; i++)
+            alloc_traits::construct(alloc, buf + i, obj.getAt(i));
+    }
+
+    void moveBuffer(Deque & obj)
+    {
+        uint count = obj.size();
+        policy = obj.policy;
+        reserved = obj.reserved;
+        capacity = obj.capacity;
+        head = 0;
+        tail = count;
+        buf = allocateBuffer(capacity);
+        for (uint i = 0; i < count; i++)
+            alloc_traits::construct(alloc, buf + i, move(obj.getAt(i)));
+    }
+
+    // Without inline storage the source is left owning no buffer (capacity 0) until its next push.
+    void stealBuffer(Deque & obj)
+    {
+        if (obj.isInline(obj.buf))
+        {
+            moveBuffer(obj);
+            obj.clear();
+            return;
+        }
+        policy = obj.policy;
+        reserved = obj.reserved;
+        buf = obj.buf;
+        capacity = obj.capacity;
+        head = obj.head;
+        tail = obj.tail;
+        obj.buf = nullptr;
+        obj.capacity = 0;
+        obj.head = obj.tail = 0;
+        obj.reserved = 0;
+        if (inline_capacity != 0)
+        {
+            obj.buf = obj.inlineData();
+            obj.capacity = inline_capacity;
+        }
+    }
+
+    void ensureCapacity(uint required_size)
+    {
+        if (required_size < capacity)
+            return;
+        uint new_capacity = max(capacity, minCapacity());
+        while (new_capacity <= required_size)
+            new_capacity = policy.grow(new_capacity);
+        reallocate(new_capacity, size());
+    }
+
+    template <typename ForwardIt> void constructRange(T* dst, ForwardIt& first, uint count, true_type)
+    {
+        memcpy(static_cast<void*>(dst), first, count * sizeof(T));
+        first += count;
+    }
+
+    template <typename ForwardIt> void constructRange(T* dst, ForwardIt& first, uint count, false_type)
+    {
+        for (uint i = 0; i < count; i++, ++first)
+            alloc_traits::construct(alloc, dst + i, *first);
+    }
+
+    template <typename ForwardIt> void writeRange(uint pos, ForwardIt first, uint count)
+    {
+        typedef integral_constant<bool, is_pointer<ForwardIt>::value && is_trivially_copyable<T>::value &&
+            is_same<typename remove_cv<typename remove_pointer<ForwardIt>::type>::type, T>::value> can_memcpy;
+
+        uint first_part = min(count, capacity - pos);
+        constructRange(buf + pos, first, first_part, can_memcpy());
+        constructRange(buf, first, count - first_part, can_memcpy());
+    }
+
+    template <typename InputIt> void appendRange(InputIt first, InputIt last, input_iterator_tag)
+    {
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+
+    template <typename ForwardIt> void appendRange(ForwardIt first, ForwardIt last, forward_iterator_tag)
+    {
+        uint count = (uint)distance(first, last);
+        if (count == 0)
+            return;
+        ensureCapacity(size() + count);
+        writeRange(tail, first, count);
+        tail = (tail + count) & (capacity - 1);
+        notePush(&deque_stats::pushes_back, count);
+    }
+
+    template <typename InputIt> void prependRange(InputIt first, InputIt last, input_iterator_tag)
+    {
+        uint count = 0;
+        for (; first != last; ++first, count++)
+            emplace_front(*first);
+        reverse(begin(), begin() + count);
+    }
+
+    template <typename ForwardIt> void prependRange(ForwardIt first, ForwardIt last, forward_iterator_tag)
+    {
+        uint count = (uint)distance(first, last);
+        if (count == 0)
+            return;
+        ensureCapacity(size() + count);
+        uint new_head = (head - count) & (capacity - 1);
+        writeRange(new_head, first, count);
+        head = new_head;
+        notePush(&deque_stats::pushes_front, count);
     }
 
 public:
 
+    typedef Allocator                   allocator_type;
     typedef container_iterator<T>       iterator;
     typedef container_iterator<const T> const_iterator;
 
-    typedef reverse_iterator<const_iterator>  const_reverse_iterator;
-    typedef reverse_iterator<iterator>        reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef std::reverse_iterator<iterator>       reverse_iterator;
 
     Deque()
-        : capacity(base_capacity), head(0), tail(0)
+        : capacity(minCapacity()), tail(0), head(0), reserved(0)
+    {
+        buf = allocateBuffer(capacity);
+    }
+
+    explicit Deque(const Allocator & user_alloc, const GrowthPolicy & user_policy = GrowthPolicy())
+        : alloc(user_alloc), policy(user_policy), capacity(minCapacity()), tail(0), head(0), reserved(0)
     {
-        buf.reset();
-        buf = unique_ptr<T[]>(new T[capacity]);
+        buf = allocateBuffer(capacity);
     }
 
-    Deque(uint user_capacity)
-        : head(0), tail(0)
+    Deque(uint user_capacity, const Allocator & user_alloc = Allocator())
+        : alloc(user_alloc), tail(0), head(0), reserved(0)
     {
-        buf.reset();
-        capacity = base_capacity;
+        capacity = minCapacity();
         while (capacity < user_capacity)
             capacity <<= 1;
-        buf = unique_ptr<T[]>(new T[capacity]);
+        buf = allocateBuffer(capacity);
+    }
+
+    template <typename InputIt, typename = typename iterator_traits<InputIt>::iterator_category>
+    Deque(InputIt first, InputIt last, const Allocator & user_alloc = Allocator())
+        : alloc(user_alloc), capacity(minCapacity()), tail(0), head(0), reserved(0)
+    {
+        buf = allocateBuffer(capacity);
+        append(first, last);
     }
 
     Deque(const Deque & obj)
-        : capacity(obj.capacity), head(obj.head), tail(obj.tail)
+        : alloc(alloc_traits::select_on_container_copy_construction(obj.alloc))
     {
-        buf.reset();
-        buf = new T[capacity];
-        for (uint i = 0; i < capacity; i++)
-            buf[i] = obj.buf[i];
+        copyBuffer(obj);
     }
 
     Deque(Deque && obj)
+        : alloc(move(obj.alloc))
     {
-        buf.reset();
-        buf.swap(obj.buf);
-        capacity = obj.capacity;
-        head = obj.head;
-        tail = obj.tail;
+        stealBuffer(obj);
     }
 
     Deque& operator = (const Deque & obj)
     {
-        capacity = obj.capacity;
-        head = obj.head;
-        tail = obj.tail;
-        buf.reset();
-        buf = unique_ptr<T[]>(new T[capacity]);
-        for (uint i = 0; i < capacity; i++)
-            buf[i] = obj.buf[i];
+        if (this == &obj)
+            return *this;
+        releaseStorage();
+        if (alloc_traits::propagate_on_container_copy_assignment::value)
+            alloc = obj.alloc;
+        copyBuffer(obj);
         return *this;
     }
 
+    Deque& operator = (Deque && obj)
+    {
+        if (this == &obj)
+            return *this;
+        if (alloc_traits::propagate_on_container_move_assignment::value || alloc == obj.alloc)
+        {
+            releaseStorage();
+            if (alloc_traits::propagate_on_container_move_assignment::value)
+                alloc = move(obj.alloc);
+            stealBuffer(obj);
+        }
+        else
+        {
+            releaseStorage();
+            moveBuffer(obj);
+        }
+        return *this;
+    }
+
+    allocator_type get_allocator() const
+    {
+        return alloc;
+    }
+
+    GrowthPolicy& get_growth_policy()
+    {
+        return policy;
+    }
+
+    const GrowthPolicy& get_growth_policy() const
+    {
+        return policy;
+    }
+
+    // Only available with an instrumented_policy.
+    const deque_stats& stats() const
+    {
+        return policy.stats();
+    }
+
     bool empty() const
     {
         return (tail == head);
@@ -289,47 +916,273 @@ public:
 
     int size() const
     {
-        if (tail >= head)
-            return tail - head;
-        return (tail - head + capacity);
+        return (tail - head) & (capacity - 1);
+    }
+
+    bool is_contiguous() const
+    {
+        return head <= tail || tail == 0;
+    }
+
+    /*
+     * Rotates the ring in place so the elements start at the beginning of the
+     * buffer and returns a pointer to them. The wrapped front part is moved down
+     * next to the back part and the two are rotated, so no memory is allocated.
+     * The pointer is valid until the next modification.
+     */
+    T* linearize()
+    {
+        if (head == 0)
+            return buf;
+        uint count = size();
+        uint first_part = min(count, capacity - head);
+        uint second_part = count - first_part;
+        shiftDown(second_part, head, first_part);
+        rotate(buf, buf + second_part, buf + count);
+        head = 0;
+        tail = count;
+        return buf;
     }
 
     void clear()
     {
-        unique_ptr<T[]> tmp = unique_ptr<T[]>(new T[base_capacity]);
-        buf.swap(tmp);
+        destroyElements(size());
         head = tail = 0;
-        capacity = base_capacity;
     }
 
-    void push_back(T obj)
+    void reserve(uint new_size)
+    {
+        ensureCapacity(new_size);
+        reserved = max(reserved, capacity);
+    }
+
+    void shrink_to_fit()
     {
-        buf[tail] = obj;
+        reserved = 0;
+        uint cur_size = size();
+        uint new_capacity = minCapacity();
+        while (new_capacity <= cur_size)
+            new_capacity <<= 1;
+        if (new_capacity < capacity)
+            reallocate(new_capacity, cur_size);
+    }
+
+    template <typename... Args> T& emplace_back(Args&&... args)
+    {
+        if (capacity == 0)
+            ensureCapacity(0);
+        alloc_traits::construct(alloc, buf + tail, forward<Args>(args)...);
         tail = nextTail();
         if (tail == head)
             extendCapacity();
+        notePush(&deque_stats::pushes_back, 1);
+        return getAt(size() - 1);
     }
 
-    void push_front(T obj)
+    template <typename... Args> T& emplace_front(Args&&... args)
     {
-        head = nextHead();
-        buf[head] = obj;
+        if (capacity == 0)
+            ensureCapacity(0);
+        uint new_head = nextHead();
+        alloc_traits::construct(alloc, buf + new_head, forward<Args>(args)...);
+        head = new_head;
         if (head == tail)
             extendCapacity();
+        notePush(&deque_stats::pushes_front, 1);
+        return getAt(0);
+    }
+
+    void push_back(const T& obj)
+    {
+        emplace_back(obj);
+    }
+
+    void push_back(T&& obj)
+    {
+        emplace_back(move(obj));
+    }
+
+    void push_front(const T& obj)
+    {
+        emplace_front(obj);
+    }
+
+    void push_front(T&& obj)
+    {
+        emplace_front(move(obj));
     }
 
     void pop_back()
     {
         tail = prevTail();
-        if (size() == capacity / 4 && capacity != base_capacity)
-            compressCapacity();
+        alloc_traits::destroy(alloc, buf + tail);
+        notePop(&deque_stats::pops_back);
+        compressCapacity();
     }
 
     void pop_front()
     {
+        alloc_traits::destroy(alloc, buf + head);
         head = prevHead();
-        if (size() == capacity / 4 && capacity != base_capacity)
-            compressCapacity();
+        notePop(&deque_stats::pops_front);
+        compressCapacity();
+    }
+
+    template <typename InputIt> void append(InputIt first, InputIt last)
+    {
+        appendRange(first, last, typename iterator_traits<InputIt>::iterator_category());
+    }
+
+    template <typename InputIt> void prepend(InputIt first, InputIt last)
+    {
+        prependRange(first, last, typename iterator_traits<InputIt>::iterator_category());
+    }
+
+    template <typename InputIt> void assign(InputIt first, InputIt last)
+    {
+        destroyElements(size());
+        head = tail = 0;
+        append(first, last);
+    }
+
+    template <typename InputIt> iterator insert(iterator pos, InputIt first, InputIt last)
+    {
+        int index = pos - begin();
+        if (index == 0)
+        {
+            prepend(first, last);
+            return begin();
+        }
+        int old_size = size();
+        append(first, last);
+        if (index != old_size)
+            rotate(begin() + index, begin() + old_size, end());
+        return begin() + index;
+    }
+
+    /*
+     * Constructs an element before pos, shifting whichever side of the ring is
+     * shorter by one slot. Trivially copyable elements are moved with memmove;
+     * others are moved one by one after growing the ring at that end.
+     */
+    template <typename... Args> iterator emplace(iterator pos, Args&&... args)
+    {
+        uint index = pos - begin();
+        uint count = size();
+        if (index == count)
+        {
+            emplace_back(forward<Args>(args)...);
+            return begin() + index;
+        }
+        if (index == 0)
+        {
+            emplace_front(forward<Args>(args)...);
+            return begin();
+        }
+        T value(forward<Args>(args)...);
+        if (is_trivially_copyable<T>::value)
+        {
+            if (index < count - index)
+            {
+                uint old_head = head;
+                head = nextHead();
+                moveTowardHead(head, old_head, index);
+                notePush(&deque_stats::pushes_front, 1);
+            }
+            else
+            {
+                uint slot = (head + index) & (capacity - 1);
+                moveTowardTail((slot + 1) & (capacity - 1), slot, count - index);
+                tail = nextTail();
+                notePush(&deque_stats::pushes_back, 1);
+            }
+            alloc_traits::construct(alloc, &getAt(index), move(value));
+            if (head == tail)
+                extendCapacity();
+        }
+        else if (index < count - index)
+        {
+            emplace_front(move(getAt(0)));
+            move(begin() + 2, begin() + index + 1, begin() + 1);
+            getAt(index) = move(value);
+        }
+        else
+        {
+            emplace_back(move(getAt(count - 1)));
+            move_backward(begin() + index, begin() + count - 1, begin() + count);
+            getAt(index) = move(value);
+        }
+        return begin() + index;
+    }
+
+    iterator insert(iterator pos, const T& obj)
+    {
+        return emplace(pos, obj);
+    }
+
+    iterator insert(iterator pos, T&& obj)
+    {
+        return emplace(pos, move(obj));
+    }
+
+    /*
+     * Removes [first, last) by closing the gap from the shorter side and
+     * returns an iterator to the element that followed the range.
+     */
+    iterator erase(iterator first, iterator last)
+    {
+        uint from = first - begin(), to = last - begin();
+        uint count = to - from, cur_size = size();
+        if (count == 0)
+            return begin() + from;
+        if (from < cur_size - to)
+        {
+            if (is_trivially_copyable<T>::value)
+                moveTowardTail((head + count) & (capacity - 1), head, from);
+            else
+            {
+                move_backward(begin(), begin() + from, begin() + to);
+                destroyRange(0, count);
+            }
+            head = (head + count) & (capacity - 1);
+        }
+        else
+        {
+            if (is_trivially_copyable<T>::value)
+                moveTowardHead((head + from) & (capacity - 1), (head + to) & (capacity - 1), cur_size - to);
+            else
+            {
+                move(begin() + to, end(), begin() + from);
+                destroyRange(cur_size - count, cur_size);
+            }
+            tail = (tail - count) & (capacity - 1);
+        }
+        compressCapacity();
+        return begin() + from;
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    // Removes every element matching pred in one compacting pass; returns how many.
+    template <typename Predicate> uint erase_if(Predicate pred)
+    {
+        uint cur_size = size(), kept = 0;
+        for (uint i = 0; i < cur_size; i++)
+        {
+            T& item = getAt(i);
+            if (pred(item))
+                continue;
+            if (kept != i)
+                getAt(kept) = move(item);
+            kept++;
+        }
+        destroyRange(kept, cur_size);
+        tail = (head + kept) & (capacity - 1);
+        compressCapacity();
+        return cur_size - kept;
     }
 
     const T back()
@@ -354,87 +1207,120 @@ public:
 
     T& operator[] (int index)
     {
-        if (index < 0 || index > size())
+        if (deque_stats* stats = statsSink())
+            stats->bounds_checks++;
+        if (index < 0 || index >= size())
             throw new exception();
         return getAt(index);
     }
 
     const T& operator[] (int index) const
     {
-        if (index < 0 || index > size())
+        if (deque_stats* stats = statsSink())
+            stats->bounds_checks++;
+        if (index < 0 || index >= size())
             throw new exception();
         return getAt(index);
     }
 
+    pair<ring_span<T>, ring_span<T> > as_spans()
+    {
+        return begin().spans_to(end());
+    }
+
+    pair<ring_span<const T>, ring_span<const T> > as_spans() const
+    {
+        return begin().spans_to(end());
+    }
+
+    template <typename F> void for_each_segment(F f)
+    {
+        pair<ring_span<T>, ring_span<T> > spans = as_spans();
+        if (!spans.first.empty())
+            f(spans.first.begin(), spans.first.end());
+        if (!spans.second.empty())
+            f(spans.second.begin(), spans.second.end());
+    }
+
+    template <typename F> void for_each_segment(F f) const
+    {
+        pair<ring_span<const T>, ring_span<const T> > spans = as_spans();
+        if (!spans.first.empty())
+            f(spans.first.begin(), spans.first.end());
+        if (!spans.second.empty())
+            f(spans.second.begin(), spans.second.end());
+    }
+
     iterator begin()
     {
-        return iterator(buf.get() + head, head, capacity, 0);
+        return iterator(buf, head, capacity, 0);
     }
     const_iterator begin() const
     {
-        return const_iterator(buf.get() + head, head, capacity, 0);
+        return const_iterator(buf, head, capacity, 0);
     }
     iterator end()
     {
-        return iterator(buf.get() + tail, tail, capacity, tail);
+        return iterator(buf, head, capacity, size());
     }
     const_iterator end() const
     {
-        return const_iterator(buf.get() + tail, tail, capacity, tail);
+        return const_iterator(buf, head, capacity, size());
     }
 
     const_iterator cbegin()
     {
-        return const_iterator(buf.get() + head, head, capacity, 0);
+        return const_iterator(buf, head, capacity, 0);
     }
     const_iterator cbegin() const
     {
-        return const_iterator(buf.get() + head, head, capacity, 0);
+        return const_iterator(buf, head, capacity, 0);
     }
     const_iterator cend()
     {
-        return const_iterator(buf.get() + tail, tail, capacity, tail);
+        return const_iterator(buf, head, capacity, size());
     }
     const_iterator cend() const
     {
-        return const_iterator(buf.get() + tail, tail, capacity, tail);
+        return const_iterator(buf, head, capacity, size());
     }
 
     reverse_iterator rbegin()
     {
-        return reverse_iterator(iterator(buf.get() + tail, tail, capacity, tail));
+        return reverse_iterator(iterator(buf, head, capacity, size()));
     }
     const_reverse_iterator rbegin() const
     {
-        return const_reverse_iterator(iterator(buf.get() + tail, tail, capacity, tail));
+        return const_reverse_iterator(iterator(buf, head, capacity, size()));
     }
     reverse_iterator rend()
     {
-        return reverse_iterator(iterator(buf.get() + head, head, capacity, 0));
+        return reverse_iterator(iterator(buf, head, capacity, 0));
     }
     const_reverse_iterator rend() const
     {
-        return const_reverse_iterator(iterator(buf.get() + head, head, capacity, 0));
+        return const_reverse_iterator(iterator(buf, head, capacity, 0));
     }
 
     const_reverse_iterator crbegin()
     {
-        return const_reverse_iterator(const_iterator(buf.get() + tail, tail, capacity, tail));
+        return const_reverse_iterator(const_iterator(buf, head, capacity, size()));
     }
     const_reverse_iterator crbegin() const
     {
-        return const_reverse_iterator(const_iterator(buf.get() + tail, tail, capacity, tail));
+        return const_reverse_iterator(const_iterator(buf, head, capacity, size()));
     }
     const_reverse_iterator crend()
     {
-        return const_reverse_iterator(const_iterator(buf.get() + head, head, capacity, 0));
+        return const_reverse_iterator(const_iterator(buf, head, capacity, 0));
     }
     const_reverse_iterator crend() const
     {
-        return const_reverse_iterator(const_iterator(buf.get() + head, head, capacity, 0));
+        return const_reverse_iterator(const_iterator(buf, head, capacity, 0));
     }
 
     ~Deque()
     {
+        releaseStorage();
     }
 };
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#include "deque.h"
+#include <numeric>
+
+/*
+ * Overloads of the common algorithms for container_iterator ranges. They walk
+ * the (at most two) contiguous parts of the ring with plain pointer loops, so
+ * full scans vectorize like scans over a vector. Unqualified calls such as
+ * for_each(d.begin(), d.end(), f) pick these over the std:: versions.
+ */
+
+// sort() runs on plain pointers when the range does not wrap, e.g. after linearize().
+template <typename T, typename Compare>
+void sort(container_iterator<T> first, container_iterator<T> last, Compare comp)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    if (spans.second.empty())
+        std::sort(spans.first.begin(), spans.first.end(), comp);
+    else
+        std::sort(first, last, comp);
+}
+
+template <typename T>
+void sort(container_iterator<T> first, container_iterator<T> last)
+{
+    sort(first, last, less<T>());
+}
+
+template <typename T, typename F>
+F for_each(container_iterator<T> first, container_iterator<T> last, F f)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    for (T* it = spans.first.begin(); it != spans.first.end(); ++it)
+        f(*it);
+    for (T* it = spans.second.begin(); it != spans.second.end(); ++it)
+        f(*it);
+    return f;
+}
+
+template <typename T, typename OutputIt>
+OutputIt copy(container_iterator<T> first, container_iterator<T> last, OutputIt out)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    out = std::copy(spans.first.begin(), spans.first.end(), out);
+    return std::copy(spans.second.begin(), spans.second.end(), out);
+}
+
+template <typename T, typename Value>
+container_iterator<T> find(container_iterator<T> first, container_iterator<T> last, const Value& value)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    T* found = std::find(spans.first.begin(), spans.first.end(), value);
+    if (found != spans.first.end())
+        return first + (int)(found - spans.first.begin());
+    found = std::find(spans.second.begin(), spans.second.end(), value);
+    return first + (int)(spans.first.size() + (found - spans.second.begin()));
+}
+
+template <typename T, typename Value>
+Value accumulate(container_iterator<T> first, container_iterator<T> last, Value init)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    init = std::accumulate(spans.first.begin(), spans.first.end(), init);
+    return std::accumulate(spans.second.begin(), spans.second.end(), init);
+}
+
+template <typename T, typename Value, typename BinaryOp>
+Value accumulate(container_iterator<T> first, container_iterator<T> last, Value init, BinaryOp op)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    init = std::accumulate(spans.first.begin(), spans.first.end(), init, op);
+    return std::accumulate(spans.second.begin(), spans.second.end(), init, op);
+}
+
+template <typename T, typename Value>
+void fill(container_iterator<T> first, container_iterator<T> last, const Value& value)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    std::fill(spans.first.begin(), spans.first.end(), value);
+    std::fill(spans.second.begin(), spans.second.end(), value);
+}
+
+template <typename T, typename InputIt>
+bool equal(container_iterator<T> first, container_iterator<T> last, InputIt other)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    for (T* it = spans.first.begin(); it != spans.first.end(); ++it, ++other)
+        if (!(*it == *other))
+            return false;
+    for (T* it = spans.second.begin(); it != spans.second.end(); ++it, ++other)
+        if (!(*it == *other))
+            return false;
+    return true;
+}
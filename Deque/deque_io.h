@@ -0,0 +1,274 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Binary snapshots of a Deque: a small header followed by the elements in
+ * logical order. Trivially copyable T is written as raw bytes, one write per
+ * ring segment; any other T goes through deque_codec<T>, which has to be
+ * specialised for it (std::string is provided). The format uses the native
+ * byte order and sizeof(T), so snapshots are meant to be read back by the same
+ * build.
+ */
+
+struct deque_stream_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t element_size;
+    uint32_t flags;
+    uint64_t count;
+};
+
+const char deque_stream_magic[4] = { 'D', 'Q', 'S', '\0' };
+const uint32_t deque_stream_version = 1;
+
+// Per-element codec for types that are not trivially copyable.
+template <typename T> struct deque_codec;
+
+template <> struct deque_codec<string>
+{
+    static void write(ostream& out, const string& value)
+    {
+        uint64_t length = value.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(value.data(), (streamsize)value.size());
+    }
+
+    static void read(istream& in, string& value)
+    {
+        uint64_t length = 0;
+        in.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!in)
+            return;
+        value.resize((size_t)length);
+        if (length != 0)
+            in.read(&value[0], (streamsize)length);
+    }
+};
+
+// streambuf over a caller-owned byte range, used to run the stream code on plain buffers.
+class span_streambuf : public streambuf
+{
+public:
+
+    span_streambuf(char* ptr, size_t size)
+    {
+        setp(ptr, ptr + size);
+        setg(ptr, ptr, ptr + size);
+    }
+
+    size_t written() const
+    {
+        return pptr() - pbase();
+    }
+
+    size_t consumed() const
+    {
+        return gptr() - eback();
+    }
+};
+
+template <typename T> uint32_t dequeElementSize()
+{
+    return is_trivially_copyable<T>::value ? (uint32_t)sizeof(T) : 0;
+}
+
+inline void dequeIoFail(const string& what)
+{
+    throw new runtime_error("Deque serialization: " + what);
+}
+
+template <typename T> void writeElements(ostream& out, const ring_span<const T>& span, true_type)
+{
+    out.write(reinterpret_cast<const char*>(span.data()), (streamsize)(span.size() * sizeof(T)));
+}
+
+template <typename T> void writeElements(ostream& out, const ring_span<const T>& span, false_type)
+{
+    for (const T& value : span)
+        deque_codec<T>::write(out, value);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+void save(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, ostream& out)
+{
+    deque_stream_header header;
+    memcpy(header.magic, deque_stream_magic, sizeof(header.magic));
+    header.version = deque_stream_version;
+    header.element_size = dequeElementSize<T>();
+    header.flags = 0;
+    header.count = (uint64_t)deque.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    writeElements(out, spans.first, is_trivially_copyable<T>());
+    writeElements(out, spans.second, is_trivially_copyable<T>());
+    if (!out)
+        dequeIoFail("write failed");
+}
+
+/*
+ * Incremental loader: reads the header up front, then read_into() appends up
+ * to max_count elements per call through a fixed-size staging chunk, so a
+ * snapshot of any size is loaded with only chunk_bytes of extra memory.
+ */
+template <typename T> class DequeReader
+{
+    istream& in;
+    uint64_t total, left;
+    vector<T> staging;
+
+    template <typename DequeType> size_t readChunk(DequeType& out, size_t count, true_type)
+    {
+        count = min(count, staging.size());
+        in.read(reinterpret_cast<char*>(staging.data()), (streamsize)(count * sizeof(T)));
+        if (!in)
+            dequeIoFail("truncated input");
+        out.append(staging.data(), staging.data() + count);
+        return count;
+    }
+
+    template <typename DequeType> size_t readChunk(DequeType& out, size_t count, false_type)
+    {
+        T value;
+        for (size_t i = 0; i < count; i++)
+        {
+            deque_codec<T>::read(in, value);
+            if (!in)
+                dequeIoFail("truncated input");
+            out.push_back(move(value));
+        }
+        return count;
+    }
+
+public:
+
+    explicit DequeReader(istream& user_in, size_t chunk_bytes = 1 << 20)
+        : in(user_in)
+    {
+        deque_stream_header header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || memcmp(header.magic, deque_stream_magic, sizeof(header.magic)) != 0)
+            dequeIoFail("not a Deque snapshot");
+        if (header.version != deque_stream_version)
+            dequeIoFail("unsupported format version " + to_string(header.version));
+        if (header.element_size != dequeElementSize<T>())
+            dequeIoFail("element size mismatch");
+        total = left = header.count;
+        if (is_trivially_copyable<T>::value)
+            staging.resize(max<size_t>(chunk_bytes / sizeof(T), 1));
+    }
+
+    uint64_t size() const
+    {
+        return total;
+    }
+
+    uint64_t remaining() const
+    {
+        return left;
+    }
+
+    template <typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+    size_t read_into(Deque<T, Allocator, GrowthPolicy, InlineCapacity>& out, size_t max_count = SIZE_MAX)
+    {
+        size_t done = 0;
+        while (left != 0 && done < max_count)
+        {
+            size_t count = (size_t)min<uint64_t>(left, max_count - done);
+            count = readChunk(out, count, is_trivially_copyable<T>());
+            left -= count;
+            done += count;
+        }
+        return done;
+    }
+};
+
+/*
+ * Replaces the contents of deque with the snapshot read from in. The deque
+ * grows chunk by chunk through append rather than being reserved up front, so
+ * its shrink floor is untouched and a corrupt count cannot force a huge
+ * allocation before the data runs out.
+ */
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+void load(Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, istream& in)
+{
+    DequeReader<T> reader(in);
+    deque.clear();
+    reader.read_into(deque);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+size_t serialized_size(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque)
+{
+    if (is_trivially_copyable<T>::value)
+        return sizeof(deque_stream_header) + deque.size() * sizeof(T);
+    struct counting_buf : streambuf
+    {
+        size_t count = 0;
+        int_type overflow(int_type c) override
+        {
+            count++;
+            return c;
+        }
+        streamsize xsputn(const char*, streamsize n) override
+        {
+            count += (size_t)n;
+            return n;
+        }
+    } counter;
+    ostream out(&counter);
+    save(deque, out);
+    return counter.count;
+}
+
+/*
+ * Writes the snapshot into out (at least serialized_size() bytes) and returns
+ * the number of bytes used. Trivially copyable elements are memcpy'd segment by
+ * segment.
+ */
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+size_t serialize_to(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, ring_span<char> out)
+{
+    span_streambuf buf(out.data(), out.size());
+    ostream stream(&buf);
+    save(deque, stream);
+    return buf.written();
+}
+
+/*
+ * Replaces the contents of deque with the snapshot in data and returns the
+ * number of bytes consumed. Aligned trivially copyable payloads are appended
+ * straight from the buffer.
+ */
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+size_t deserialize_from(Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, ring_span<const char> data)
+{
+    span_streambuf buf(const_cast<char*>(data.data()), data.size());
+    istream stream(&buf);
+    DequeReader<T> reader(stream);
+    deque.clear();
+
+    const char* payload = data.data() + buf.consumed();
+    if (is_trivially_copyable<T>::value && reinterpret_cast<uintptr_t>(payload) % alignof(T) == 0)
+    {
+        if (reader.size() > (data.size() - buf.consumed()) / sizeof(T))
+            dequeIoFail("truncated input");
+        const T* first = reinterpret_cast<const T*>(payload);
+        deque.append(first, first + reader.size());
+        return buf.consumed() + (size_t)reader.size() * sizeof(T);
+    }
+    reader.read_into(deque);
+    return buf.consumed();
+}
@@ -0,0 +1,625 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+/*
+ * Vectorized scans (find, count, count_greater, min, max, sum) for Deque of
+ * arithmetic types. They run over the ring's two contiguous segments. int and
+ * float have SSE2 and AVX2 kernels picked at runtime from what the CPU
+ * supports; every other type, and non-x86 targets, use the scalar loops.
+ */
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEQUE_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DEQUE_TARGET_SSE2
+#define DEQUE_TARGET_AVX2
+#else
+#define DEQUE_TARGET_SSE2 __attribute__((target("sse2")))
+#define DEQUE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define DEQUE_SIMD_X86 0
+#endif
+
+enum simd_isa
+{
+    simd_scalar,
+    simd_sse2,
+    simd_avx2
+};
+
+inline simd_isa detectSimdIsa()
+{
+#if DEQUE_SIMD_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (max_leaf >= 7 && os_avx)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse2 = __builtin_cpu_supports("sse2");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2)
+        return simd_avx2;
+    if (sse2)
+        return simd_sse2;
+#endif
+    return simd_scalar;
+}
+
+inline simd_isa detected_simd_isa()
+{
+    static const simd_isa isa = detectSimdIsa();
+    return isa;
+}
+
+// Kernel level in use; may be lowered (e.g. for benchmarks), never above detected_simd_isa().
+inline simd_isa& active_simd_isa()
+{
+    static simd_isa isa = detected_simd_isa();
+    return isa;
+}
+
+template <typename T> struct scalar_kernels
+{
+    typedef typename conditional<is_floating_point<T>::value, double,
+        typename conditional<is_signed<T>::value, long long, unsigned long long>::type>::type sum_type;
+
+    static size_t find(const T* ptr, size_t n, T value)
+    {
+        for (size_t i = 0; i < n; i++)
+            if (ptr[i] == value)
+                return i;
+        return n;
+    }
+
+    static size_t count(const T* ptr, size_t n, T value)
+    {
+        size_t result = 0;
+        for (size_t i = 0; i < n; i++)
+            result += ptr[i] == value;
+        return result;
+    }
+
+    static size_t count_greater(const T* ptr, size_t n, T threshold)
+    {
+        size_t result = 0;
+        for (size_t i = 0; i < n; i++)
+            result += ptr[i] > threshold;
+        return result;
+    }
+
+    static T min(const T* ptr, size_t n, T init)
+    {
+        for (size_t i = 0; i < n; i++)
+            init = ptr[i] < init ? ptr[i] : init;
+        return init;
+    }
+
+    static T max(const T* ptr, size_t n, T init)
+    {
+        for (size_t i = 0; i < n; i++)
+            init = ptr[i] > init ? ptr[i] : init;
+        return init;
+    }
+
+    static sum_type sum(const T* ptr, size_t n)
+    {
+        sum_type result = 0;
+        for (size_t i = 0; i < n; i++)
+            result += ptr[i];
+        return result;
+    }
+};
+
+template <typename T> struct simd_kernels : scalar_kernels<T>
+{
+};
+
+#if DEQUE_SIMD_X86
+
+inline uint lowestBit(uint mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint)index;
+#else
+    return (uint)__builtin_ctz(mask);
+#endif
+}
+
+DEQUE_TARGET_SSE2 inline long long horizontalSum(__m128i acc64)
+{
+    long long lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc64);
+    return lanes[0] + lanes[1];
+}
+
+DEQUE_TARGET_SSE2 inline size_t horizontalCount(__m128i acc32)
+{
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc32);
+    return (size_t)(uint)-lanes[0] + (uint)-lanes[1] + (uint)-lanes[2] + (uint)-lanes[3];
+}
+
+DEQUE_TARGET_AVX2 inline size_t horizontalCount(__m256i acc32)
+{
+    return horizontalCount(_mm256_castsi256_si128(acc32)) + horizontalCount(_mm256_extracti128_si256(acc32, 1));
+}
+
+/*
+ * The count loops keep per-lane counters (hits are -1 lanes, so the counters
+ * go negative) and flush them every count_flush elements, long before a lane
+ * could overflow. n must be a multiple of the vector width.
+ */
+const size_t count_flush = 1 << 30;
+
+template <typename T, typename Compare>
+DEQUE_TARGET_SSE2 inline size_t countSse2(const T* ptr, size_t n, Compare compare)
+{
+    size_t result = 0, i = 0;
+    while (i < n)
+    {
+        __m128i acc = _mm_setzero_si128();
+        size_t block_end = i + min(n - i, count_flush);
+        for (; i < block_end; i += 4)
+            acc = _mm_add_epi32(acc, compare(_mm_loadu_si128((const __m128i*)(ptr + i))));
+        result += horizontalCount(acc);
+    }
+    return result;
+}
+
+template <typename T, typename Compare>
+DEQUE_TARGET_AVX2 inline size_t countAvx2(const T* ptr, size_t n, Compare compare)
+{
+    size_t result = 0, i = 0;
+    while (i < n)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        size_t block_end = i + min(n - i, count_flush);
+        for (; i < block_end; i += 8)
+            acc = _mm256_add_epi32(acc, compare(_mm256_loadu_si256((const __m256i*)(ptr + i))));
+        result += horizontalCount(acc);
+    }
+    return result;
+}
+
+// ---- int, SSE2 ----
+
+struct equal_epi32_sse2
+{
+    __m128i needle;
+    DEQUE_TARGET_SSE2 __m128i operator()(__m128i v) const { return _mm_cmpeq_epi32(v, needle); }
+};
+
+struct greater_epi32_sse2
+{
+    __m128i threshold;
+    DEQUE_TARGET_SSE2 __m128i operator()(__m128i v) const { return _mm_cmpgt_epi32(v, threshold); }
+};
+
+DEQUE_TARGET_SSE2 inline size_t findSse2(const int* ptr, size_t n, int value)
+{
+    __m128i needle = _mm_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint mask = (uint)_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(ptr + i)), needle));
+        if (mask != 0)
+            return i + lowestBit(mask) / 4;
+    }
+    return i + scalar_kernels<int>::find(ptr + i, n - i, value);
+}
+
+DEQUE_TARGET_SSE2 inline size_t countSse2(const int* ptr, size_t n, int value)
+{
+    equal_epi32_sse2 compare = { _mm_set1_epi32(value) };
+    return countSse2(ptr, n, compare);
+}
+
+DEQUE_TARGET_SSE2 inline size_t countGreaterSse2(const int* ptr, size_t n, int threshold)
+{
+    greater_epi32_sse2 compare = { _mm_set1_epi32(threshold) };
+    return countSse2(ptr, n, compare);
+}
+
+DEQUE_TARGET_SSE2 inline int minMaxSse2(const int* ptr, size_t n, int init, bool take_max)
+{
+    __m128i acc = _mm_set1_epi32(init);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+        __m128i replace = take_max ? _mm_cmpgt_epi32(v, acc) : _mm_cmplt_epi32(v, acc);
+        acc = _mm_or_si128(_mm_and_si128(replace, v), _mm_andnot_si128(replace, acc));
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    fori(k, 4)
+        init = take_max ? max(init, lanes[k]) : min(init, lanes[k]);
+    return take_max ? scalar_kernels<int>::max(ptr + i, n - i, init) : scalar_kernels<int>::min(ptr + i, n - i, init);
+}
+
+DEQUE_TARGET_SSE2 inline long long sumSse2(const int* ptr, size_t n)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+        __m128i sign = _mm_srai_epi32(v, 31);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+    }
+    return horizontalSum(acc) + scalar_kernels<int>::sum(ptr + i, n - i);
+}
+
+// ---- int, AVX2 ----
+
+struct equal_epi32_avx2
+{
+    __m256i needle;
+    DEQUE_TARGET_AVX2 __m256i operator()(__m256i v) const { return _mm256_cmpeq_epi32(v, needle); }
+};
+
+struct greater_epi32_avx2
+{
+    __m256i threshold;
+    DEQUE_TARGET_AVX2 __m256i operator()(__m256i v) const { return _mm256_cmpgt_epi32(v, threshold); }
+};
+
+DEQUE_TARGET_AVX2 inline size_t findAvx2(const int* ptr, size_t n, int value)
+{
+    __m256i needle = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint mask = (uint)_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(ptr + i)), needle));
+        if (mask != 0)
+            return i + lowestBit(mask) / 4;
+    }
+    return i + scalar_kernels<int>::find(ptr + i, n - i, value);
+}
+
+DEQUE_TARGET_AVX2 inline size_t countAvx2(const int* ptr, size_t n, int value)
+{
+    equal_epi32_avx2 compare = { _mm256_set1_epi32(value) };
+    return countAvx2(ptr, n, compare);
+}
+
+DEQUE_TARGET_AVX2 inline size_t countGreaterAvx2(const int* ptr, size_t n, int threshold)
+{
+    greater_epi32_avx2 compare = { _mm256_set1_epi32(threshold) };
+    return countAvx2(ptr, n, compare);
+}
+
+DEQUE_TARGET_AVX2 inline int minMaxAvx2(const int* ptr, size_t n, int init, bool take_max)
+{
+    __m256i acc = _mm256_set1_epi32(init);
+    size_t i = 0;
+    if (take_max)
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_max_epi32(acc, _mm256_loadu_si256((const __m256i*)(ptr + i)));
+    else
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_min_epi32(acc, _mm256_loadu_si256((const __m256i*)(ptr + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    fori(k, 8)
+        init = take_max ? max(init, lanes[k]) : min(init, lanes[k]);
+    return take_max ? scalar_kernels<int>::max(ptr + i, n - i, init) : scalar_kernels<int>::min(ptr + i, n - i, init);
+}
+
+DEQUE_TARGET_AVX2 inline long long sumAvx2(const int* ptr, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(ptr + i));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_kernels<int>::sum(ptr + i, n - i);
+}
+
+// ---- float, SSE2 ----
+
+struct equal_ps_sse2
+{
+    __m128 needle;
+    DEQUE_TARGET_SSE2 __m128i operator()(__m128i v) const { return _mm_castps_si128(_mm_cmpeq_ps(_mm_castsi128_ps(v), needle)); }
+};
+
+struct greater_ps_sse2
+{
+    __m128 threshold;
+    DEQUE_TARGET_SSE2 __m128i operator()(__m128i v) const { return _mm_castps_si128(_mm_cmpgt_ps(_mm_castsi128_ps(v), threshold)); }
+};
+
+DEQUE_TARGET_SSE2 inline size_t findSse2(const float* ptr, size_t n, float value)
+{
+    __m128 needle = _mm_set1_ps(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint mask = (uint)_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(ptr + i), needle));
+        if (mask != 0)
+            return i + lowestBit(mask);
+    }
+    return i + scalar_kernels<float>::find(ptr + i, n - i, value);
+}
+
+DEQUE_TARGET_SSE2 inline size_t countSse2(const float* ptr, size_t n, float value)
+{
+    equal_ps_sse2 compare = { _mm_set1_ps(value) };
+    return countSse2(ptr, n, compare);
+}
+
+DEQUE_TARGET_SSE2 inline size_t countGreaterSse2(const float* ptr, size_t n, float threshold)
+{
+    greater_ps_sse2 compare = { _mm_set1_ps(threshold) };
+    return countSse2(ptr, n, compare);
+}
+
+// NaNs in the data are skipped, as in the scalar loops: minps/maxps return the second operand then.
+DEQUE_TARGET_SSE2 inline float minMaxSse2(const float* ptr, size_t n, float init, bool take_max)
+{
+    __m128 acc = _mm_set1_ps(init);
+    size_t i = 0;
+    if (take_max)
+        for (; i + 4 <= n; i += 4)
+            acc = _mm_max_ps(_mm_loadu_ps(ptr + i), acc);
+    else
+        for (; i + 4 <= n; i += 4)
+            acc = _mm_min_ps(_mm_loadu_ps(ptr + i), acc);
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return take_max ? scalar_kernels<float>::max(ptr + i, n - i, scalar_kernels<float>::max(lanes, 4, init))
+                    : scalar_kernels<float>::min(ptr + i, n - i, scalar_kernels<float>::min(lanes, 4, init));
+}
+
+DEQUE_TARGET_SSE2 inline double sumSse2(const float* ptr, size_t n)
+{
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(ptr + i);
+        acc = _mm_add_pd(acc, _mm_cvtps_pd(v));
+        acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + scalar_kernels<float>::sum(ptr + i, n - i);
+}
+
+// ---- float, AVX2 ----
+
+struct equal_ps_avx2
+{
+    __m256 needle;
+    DEQUE_TARGET_AVX2 __m256i operator()(__m256i v) const { return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(v), needle, _CMP_EQ_OQ)); }
+};
+
+struct greater_ps_avx2
+{
+    __m256 threshold;
+    DEQUE_TARGET_AVX2 __m256i operator()(__m256i v) const { return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(v), threshold, _CMP_GT_OQ)); }
+};
+
+DEQUE_TARGET_AVX2 inline size_t findAvx2(const float* ptr, size_t n, float value)
+{
+    __m256 needle = _mm256_set1_ps(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint mask = (uint)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(ptr + i), needle, _CMP_EQ_OQ));
+        if (mask != 0)
+            return i + lowestBit(mask);
+    }
+    return i + scalar_kernels<float>::find(ptr + i, n - i, value);
+}
+
+DEQUE_TARGET_AVX2 inline size_t countAvx2(const float* ptr, size_t n, float value)
+{
+    equal_ps_avx2 compare = { _mm256_set1_ps(value) };
+    return countAvx2(ptr, n, compare);
+}
+
+DEQUE_TARGET_AVX2 inline size_t countGreaterAvx2(const float* ptr, size_t n, float threshold)
+{
+    greater_ps_avx2 compare = { _mm256_set1_ps(threshold) };
+    return countAvx2(ptr, n, compare);
+}
+
+DEQUE_TARGET_AVX2 inline float minMaxAvx2(const float* ptr, size_t n, float init, bool take_max)
+{
+    __m256 acc = _mm256_set1_ps(init);
+    size_t i = 0;
+    if (take_max)
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_max_ps(_mm256_loadu_ps(ptr + i), acc);
+    else
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_min_ps(_mm256_loadu_ps(ptr + i), acc);
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    return take_max ? scalar_kernels<float>::max(ptr + i, n - i, scalar_kernels<float>::max(lanes, 8, init))
+                    : scalar_kernels<float>::min(ptr + i, n - i, scalar_kernels<float>::min(lanes, 8, init));
+}
+
+DEQUE_TARGET_AVX2 inline double sumAvx2(const float* ptr, size_t n)
+{
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(ptr + i);
+        acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+        acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_kernels<float>::sum(ptr + i, n - i);
+}
+
+/*
+ * Dispatching kernels for the types above. Count kernels run on the part of
+ * the range that is a whole number of vectors and finish with the scalar loop.
+ */
+template <typename T> struct dispatched_kernels : scalar_kernels<T>
+{
+    typedef scalar_kernels<T> scalar;
+    typedef typename scalar::sum_type sum_type;
+
+    static size_t find(const T* ptr, size_t n, T value)
+    {
+        if (active_simd_isa() >= simd_avx2)
+            return findAvx2(ptr, n, value);
+        if (active_simd_isa() >= simd_sse2)
+            return findSse2(ptr, n, value);
+        return scalar::find(ptr, n, value);
+    }
+
+    static size_t count(const T* ptr, size_t n, T value)
+    {
+        if (active_simd_isa() >= simd_avx2)
+            return countAvx2(ptr, n / 8 * 8, value) + scalar::count(ptr + n / 8 * 8, n % 8, value);
+        if (active_simd_isa() >= simd_sse2)
+            return countSse2(ptr, n / 4 * 4, value) + scalar::count(ptr + n / 4 * 4, n % 4, value);
+        return scalar::count(ptr, n, value);
+    }
+
+    static size_t count_greater(const T* ptr, size_t n, T threshold)
+    {
+        if (active_simd_isa() >= simd_avx2)
+            return countGreaterAvx2(ptr, n / 8 * 8, threshold) + scalar::count_greater(ptr + n / 8 * 8, n % 8, threshold);
+        if (active_simd_isa() >= simd_sse2)
+            return countGreaterSse2(ptr, n / 4 * 4, threshold) + scalar::count_greater(ptr + n / 4 * 4, n % 4, threshold);
+        return scalar::count_greater(ptr, n, threshold);
+    }
+
+    static T min(const T* ptr, size_t n, T init)
+    {
+        if (active_simd_isa() >= simd_avx2)
+            return minMaxAvx2(ptr, n, init, false);
+        if (active_simd_isa() >= simd_sse2)
+            return minMaxSse2(ptr, n, init, false);
+        return scalar::min(ptr, n, init);
+    }
+
+    static T max(const T* ptr, size_t n, T init)
+    {
+        if (active_simd_isa() >= simd_avx2)
+            return minMaxAvx2(ptr, n, init, true);
+        if (active_simd_isa() >= simd_sse2)
+            return minMaxSse2(ptr, n, init, true);
+        return scalar::max(ptr, n, init);
+    }
+
+    static sum_type sum(const T* ptr, size_t n)
+    {
+        if (active_simd_isa() >= simd_avx2)
+            return sumAvx2(ptr, n);
+        if (active_simd_isa() >= simd_sse2)
+            return sumSse2(ptr, n);
+        return scalar::sum(ptr, n);
+    }
+};
+
+template <> struct simd_kernels<int> : dispatched_kernels<int>
+{
+};
+
+template <> struct simd_kernels<float> : dispatched_kernels<float>
+{
+};
+
+#endif
+
+/*
+ * Deque front ends. Each kernel runs over both segments of the ring; find
+ * returns the logical index of the first match or -1, min/max throw on an
+ * empty deque like operator[] does for a bad index.
+ */
+template <typename T> struct simd_value
+{
+    typedef T type;
+};
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+int simd_find(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, typename simd_value<T>::type value)
+{
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    size_t index = simd_kernels<T>::find(spans.first.data(), spans.first.size(), value);
+    if (index != spans.first.size())
+        return (int)index;
+    index = simd_kernels<T>::find(spans.second.data(), spans.second.size(), value);
+    if (index != spans.second.size())
+        return (int)(spans.first.size() + index);
+    return -1;
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+size_t simd_count(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, typename simd_value<T>::type value)
+{
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    return simd_kernels<T>::count(spans.first.data(), spans.first.size(), value) +
+           simd_kernels<T>::count(spans.second.data(), spans.second.size(), value);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+size_t simd_count_greater(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque, typename simd_value<T>::type threshold)
+{
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    return simd_kernels<T>::count_greater(spans.first.data(), spans.first.size(), threshold) +
+           simd_kernels<T>::count_greater(spans.second.data(), spans.second.size(), threshold);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+T simd_min(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque)
+{
+    if (deque.empty())
+        throw new exception();
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    T result = simd_kernels<T>::min(spans.first.data(), spans.first.size(), spans.first[0]);
+    return simd_kernels<T>::min(spans.second.data(), spans.second.size(), result);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+T simd_max(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque)
+{
+    if (deque.empty())
+        throw new exception();
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    T result = simd_kernels<T>::max(spans.first.data(), spans.first.size(), spans.first[0]);
+    return simd_kernels<T>::max(spans.second.data(), spans.second.size(), result);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+typename scalar_kernels<T>::sum_type simd_sum(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque)
+{
+    pair<ring_span<const T>, ring_span<const T> > spans = deque.as_spans();
+    return simd_kernels<T>::sum(spans.first.data(), spans.first.size()) +
+           simd_kernels<T>::sum(spans.second.data(), spans.second.size());
+}
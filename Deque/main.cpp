@@ -62,7 +62,9 @@ int main(int argc, char **argv)
         cout << d.back() << ' ';
         d.pop_back();
     }
+#ifdef _MSC_VER
 	system("pause");
+#endif
 
     return 0;
 }
\ No newline at end of file
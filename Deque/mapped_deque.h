@@ -0,0 +1,310 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * File layout of MappedDeque: a fixed header followed, at data offset, by the
+ * ring of capacity elements. head and tail are free-running 64-bit positions
+ * (element i lives in slot (head + i) & (capacity - 1)), so every update of the
+ * ring state is a single aligned 8-byte store.
+ */
+struct mapped_deque_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t element_size;
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t tail;
+};
+
+const char mapped_deque_magic[8] = { 'M', 'D', 'E', 'Q', 'U', 'E', '\0', '\0' };
+const uint32_t mapped_deque_version = 1;
+const size_t mapped_deque_data_offset = 64;
+
+/*
+ * Deque of trivially copyable T whose whole state lives in a memory-mapped
+ * file, so reopening the file is an mmap rather than a reload.
+ *
+ * Crash consistency: an element is written before the head/tail store that
+ * makes it visible, and growth first extends the file and copies the elements
+ * that move into the new upper half, leaving the old layout intact, before it
+ * publishes the new capacity. A process killed at any point therefore leaves a
+ * file that reopens to the state before or after the interrupted operation.
+ * Surviving power loss additionally needs flush(), which msyncs the mapping.
+ */
+template <typename T> class MappedDeque
+{
+    static_assert(is_trivially_copyable<T>::value, "MappedDeque stores T as raw bytes");
+    static_assert(alignof(T) <= mapped_deque_data_offset, "T is over-aligned for the data offset");
+
+    int fd;
+    char* base;
+    size_t mapped_size;
+    mapped_deque_header* header;
+    T* data;
+
+    static size_t fileSize(uint64_t capacity)
+    {
+        return mapped_deque_data_offset + capacity * sizeof(T);
+    }
+
+    static void fail(const string& what)
+    {
+        throw new runtime_error("MappedDeque: " + what);
+    }
+
+    void mapFile(size_t size)
+    {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+            fail("mmap failed");
+        base = static_cast<char*>(ptr);
+        mapped_size = size;
+        header = reinterpret_cast<mapped_deque_header*>(base);
+        data = reinterpret_cast<T*>(base + mapped_deque_data_offset);
+    }
+
+    void unmapFile()
+    {
+        if (base != nullptr)
+            munmap(base, mapped_size);
+        base = nullptr;
+        header = nullptr;
+        data = nullptr;
+    }
+
+    void resizeFile(size_t size)
+    {
+        if (ftruncate(fd, (off_t)size) != 0)
+            fail("cannot resize the file");
+    }
+
+    // Orders the preceding element writes before the store that publishes them.
+    static void publish(uint64_t& field, uint64_t value)
+    {
+        atomic_thread_fence(memory_order_release);
+        field = value;
+    }
+
+    T& slot(uint64_t pos) const
+    {
+        return data[pos & (header->capacity - 1)];
+    }
+
+    void create(uint initial_capacity)
+    {
+        uint64_t capacity = base_capacity;
+        while (capacity < initial_capacity)
+            capacity <<= 1;
+        resizeFile(fileSize(capacity));
+        mapFile(fileSize(capacity));
+        header->version = mapped_deque_version;
+        header->element_size = sizeof(T);
+        header->capacity = capacity;
+        header->head = header->tail = 0;
+        atomic_thread_fence(memory_order_release);
+        memcpy(header->magic, mapped_deque_magic, sizeof(mapped_deque_magic));
+    }
+
+    void attach(size_t file_size)
+    {
+        mapFile(file_size);
+        if (memcmp(header->magic, mapped_deque_magic, sizeof(mapped_deque_magic)) != 0)
+            fail("not a MappedDeque file");
+        if (header->version != mapped_deque_version)
+            fail("unsupported format version " + to_string(header->version));
+        if (header->element_size != sizeof(T))
+            fail("element size mismatch");
+        uint64_t capacity = header->capacity;
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0 || fileSize(capacity) > file_size ||
+            header->tail - header->head > capacity)
+            fail("corrupted header");
+    }
+
+    void grow()
+    {
+        uint64_t old_capacity = header->capacity, new_capacity = old_capacity * 2;
+        uint64_t head = header->head, tail = header->tail;
+        size_t new_size = fileSize(new_capacity);
+        resizeFile(new_size);
+        unmapFile();
+        mapFile(new_size);
+        for (uint64_t pos = head; pos != tail; pos++)
+            if ((pos & old_capacity) != 0)
+                data[pos & (new_capacity - 1)] = data[pos & (old_capacity - 1)];
+        publish(header->capacity, new_capacity);
+    }
+
+public:
+
+    typedef container_iterator<T>       iterator;
+    typedef container_iterator<const T> const_iterator;
+
+    /*
+     * Opens path, creating an empty deque if the file does not exist or was
+     * never fully initialised. Throws runtime_error* when the file is not a
+     * MappedDeque of this T and format version.
+     */
+    explicit MappedDeque(const string& path, uint initial_capacity = base_capacity)
+        : base(nullptr), mapped_size(0), header(nullptr), data(nullptr)
+    {
+        fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            fail("cannot open " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            fail("cannot stat " + path);
+        }
+        try
+        {
+            char magic[sizeof(mapped_deque_magic)] = {};
+            if ((size_t)info.st_size >= mapped_deque_data_offset)
+                if (pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic))
+                    fail("cannot read the header");
+            bool blank = true;
+            for (char c : magic)
+                blank = blank && c == '\0';
+            if (blank)
+                create(initial_capacity);
+            else
+                attach((size_t)info.st_size);
+        }
+        catch (...)
+        {
+            unmapFile();
+            close(fd);
+            throw;
+        }
+    }
+
+    MappedDeque(const MappedDeque &) = delete;
+    MappedDeque& operator = (const MappedDeque &) = delete;
+
+    size_t size() const
+    {
+        return (size_t)(header->tail - header->head);
+    }
+
+    bool empty() const
+    {
+        return header->tail == header->head;
+    }
+
+    size_t get_capacity() const
+    {
+        return (size_t)header->capacity;
+    }
+
+    void push_back(const T& obj)
+    {
+        if (size() == header->capacity)
+            grow();
+        uint64_t tail = header->tail;
+        slot(tail) = obj;
+        publish(header->tail, tail + 1);
+    }
+
+    void push_front(const T& obj)
+    {
+        if (size() == header->capacity)
+            grow();
+        uint64_t head = header->head - 1;
+        slot(head) = obj;
+        publish(header->head, head);
+    }
+
+    void pop_back()
+    {
+        if (empty())
+            throw new exception();
+        publish(header->tail, header->tail - 1);
+    }
+
+    void pop_front()
+    {
+        if (empty())
+            throw new exception();
+        publish(header->head, header->head + 1);
+    }
+
+    void clear()
+    {
+        publish(header->head, header->tail);
+    }
+
+    const T front() const
+    {
+        return operator[](0);
+    }
+
+    const T back() const
+    {
+        return operator[]((int)size() - 1);
+    }
+
+    T& operator[] (int index)
+    {
+        if (index < 0 || (size_t)index >= size())
+            throw new exception();
+        return slot(header->head + index);
+    }
+
+    const T& operator[] (int index) const
+    {
+        if (index < 0 || (size_t)index >= size())
+            throw new exception();
+        return slot(header->head + index);
+    }
+
+    iterator begin()
+    {
+        return iterator(data, (uint)(header->head & (header->capacity - 1)), (uint)header->capacity, 0);
+    }
+    iterator end()
+    {
+        return iterator(data, (uint)(header->head & (header->capacity - 1)), (uint)header->capacity, (int)size());
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(data, (uint)(header->head & (header->capacity - 1)), (uint)header->capacity, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(data, (uint)(header->head & (header->capacity - 1)), (uint)header->capacity, (int)size());
+    }
+
+    pair<ring_span<T>, ring_span<T> > as_spans()
+    {
+        return begin().spans_to(end());
+    }
+
+    // Durability point: writes the mapping and the file size back to disk.
+    void flush()
+    {
+        if (msync(base, mapped_size, MS_SYNC) != 0 || fsync(fd) != 0)
+            fail("flush failed");
+    }
+
+    ~MappedDeque()
+    {
+        unmapFile();
+        close(fd);
+    }
+};
+
+#endif
@@ -0,0 +1,317 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#endif
+
+enum class mirror_mode
+{
+    automatic,
+    plain
+};
+
+/*
+ * Deque of trivially copyable T whose ring is mapped twice, back to back, in
+ * virtual memory (memfd + two MAP_SHARED mappings of the same pages). Slot
+ * capacity + i is slot i, so element i always lives at base[head + i] and any
+ * run of up to capacity elements is one pointer range: data() and window()
+ * never copy, and as_spans() returns a single span.
+ *
+ * Capacities are powers of two whose byte size is a multiple of the page size.
+ * Where the double mapping is unavailable (not Linux, no memfd, or
+ * mirror_mode::plain) the storage is an ordinary ring; everything works the
+ * same, but data() and window() then linearize the ring first.
+ *
+ * Elements are addressed as base[(head + i) & (span - 1)], with span equal to
+ * 2 * capacity when mirrored (so the mask never changes the index) and to
+ * capacity otherwise; container_iterator works unchanged in both modes.
+ */
+template <typename T> class MirroredDeque
+{
+    static_assert(is_trivially_copyable<T>::value, "MirroredDeque stores T as raw bytes");
+
+    T* buf;
+    uint capacity, span;
+    uint head, count;
+    bool mirrored;
+    mirror_mode mode;
+    allocator<T> alloc;
+
+    static size_t pageSize()
+    {
+#if defined(__linux__)
+        return (size_t)sysconf(_SC_PAGESIZE);
+#else
+        return 4096;
+#endif
+    }
+
+    static uint roundCapacity(uint requested)
+    {
+        size_t page = pageSize();
+        uint result = 1;
+        while (result < requested || (result * sizeof(T)) % page != 0)
+            result <<= 1;
+        return result;
+    }
+
+    // Returns nullptr when the pages cannot be mirrored.
+    static T* mapMirrored(size_t bytes)
+    {
+#if defined(__linux__) && defined(SYS_memfd_create)
+        int fd = (int)syscall(SYS_memfd_create, "mirrored_deque", MFD_CLOEXEC);
+        if (fd < 0)
+            return nullptr;
+        char* base = nullptr;
+        if (ftruncate(fd, (off_t)bytes) == 0)
+        {
+            void* reserved = mmap(nullptr, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (reserved != MAP_FAILED)
+            {
+                base = static_cast<char*>(reserved);
+                if (mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+                    mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+                {
+                    munmap(base, 2 * bytes);
+                    base = nullptr;
+                }
+            }
+        }
+        close(fd);
+        return reinterpret_cast<T*>(base);
+#else
+        (void)bytes;
+        return nullptr;
+#endif
+    }
+
+    void allocate(uint new_capacity)
+    {
+        buf = nullptr;
+        if (mode == mirror_mode::automatic)
+            buf = mapMirrored(new_capacity * sizeof(T));
+        mirrored = buf != nullptr;
+        if (!mirrored)
+            buf = alloc.allocate(new_capacity);
+        capacity = new_capacity;
+        span = mirrored ? 2 * capacity : capacity;
+    }
+
+    void releaseStorage(T* ptr, uint old_capacity, bool was_mirrored)
+    {
+        if (ptr == nullptr)
+            return;
+#if defined(__linux__)
+        if (was_mirrored)
+        {
+            munmap(ptr, 2 * (size_t)old_capacity * sizeof(T));
+            return;
+        }
+#endif
+        (void)was_mirrored;
+        alloc.deallocate(ptr, old_capacity);
+    }
+
+    T& slot(uint index) const
+    {
+        return buf[(head + index) & (span - 1)];
+    }
+
+    void grow()
+    {
+        T* old_buf = buf;
+        uint old_capacity = capacity;
+        bool old_mirrored = mirrored;
+        pair<ring_span<T>, ring_span<T> > spans = as_spans();
+
+        // A moved-from deque has no buffer yet.
+        allocate(old_capacity != 0 ? old_capacity * 2 : roundCapacity(1));
+        if (old_buf != nullptr)
+        {
+            memcpy(static_cast<void*>(buf), spans.first.data(), spans.first.size() * sizeof(T));
+            memcpy(static_cast<void*>(buf + spans.first.size()), spans.second.data(), spans.second.size() * sizeof(T));
+        }
+        head = 0;
+        releaseStorage(old_buf, old_capacity, old_mirrored);
+    }
+
+    /*
+     * Plain mode only: moves the elements to start at slot 0. The run
+     * [head, capacity) is moved down behind the wrapped run [0, second_part)
+     * and the two are rotated, so free slots are never touched.
+     */
+    void linearize()
+    {
+        if (mirrored || head + count <= capacity)
+            return;
+        uint first_part = capacity - head;
+        uint second_part = count - first_part;
+        memmove(static_cast<void*>(buf + second_part), buf + head, first_part * sizeof(T));
+        rotate(buf, buf + second_part, buf + count);
+        head = 0;
+    }
+
+public:
+
+    typedef container_iterator<T>       iterator;
+    typedef container_iterator<const T> const_iterator;
+
+    explicit MirroredDeque(uint initial_capacity = base_capacity, mirror_mode user_mode = mirror_mode::automatic)
+        : head(0), count(0), mode(user_mode)
+    {
+        allocate(roundCapacity(max(initial_capacity, 1u)));
+    }
+
+    MirroredDeque(MirroredDeque && obj)
+        : buf(obj.buf), capacity(obj.capacity), span(obj.span), head(obj.head), count(obj.count),
+          mirrored(obj.mirrored), mode(obj.mode)
+    {
+        obj.buf = nullptr;
+        obj.capacity = obj.span = 0;
+        obj.head = obj.count = 0;
+        obj.mirrored = false;
+    }
+
+    MirroredDeque(const MirroredDeque &) = delete;
+    MirroredDeque& operator = (const MirroredDeque &) = delete;
+
+    bool is_mirrored() const
+    {
+        return mirrored;
+    }
+
+    uint size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    uint get_capacity() const
+    {
+        return capacity;
+    }
+
+    void clear()
+    {
+        head = count = 0;
+    }
+
+    void push_back(const T& obj)
+    {
+        if (count == capacity)
+            grow();
+        new (&slot(count)) T(obj);
+        count++;
+    }
+
+    void push_front(const T& obj)
+    {
+        if (count == capacity)
+            grow();
+        head = (head - 1) & (capacity - 1);
+        new (buf + head) T(obj);
+        count++;
+    }
+
+    void pop_back()
+    {
+        if (count == 0)
+            throw new exception();
+        count--;
+    }
+
+    void pop_front()
+    {
+        if (count == 0)
+            throw new exception();
+        head = (head + 1) & (capacity - 1);
+        count--;
+    }
+
+    const T front() const
+    {
+        return operator[](0);
+    }
+
+    const T back() const
+    {
+        return operator[]((int)count - 1);
+    }
+
+    T& operator[] (int index)
+    {
+        if (index < 0 || index >= (int)count)
+            throw new exception();
+        return slot(index);
+    }
+
+    const T& operator[] (int index) const
+    {
+        if (index < 0 || index >= (int)count)
+            throw new exception();
+        return slot(index);
+    }
+
+    // Pointer to size() contiguous elements; valid until the next push.
+    T* data()
+    {
+        linearize();
+        return buf + head;
+    }
+
+    // Contiguous view of elements [first, first + length).
+    ring_span<T> window(uint first, uint length)
+    {
+        if (first > count || length > count - first)
+            throw new exception();
+        return ring_span<T>(data() + first, length);
+    }
+
+    pair<ring_span<T>, ring_span<T> > as_spans()
+    {
+        return begin().spans_to(end());
+    }
+
+    pair<ring_span<const T>, ring_span<const T> > as_spans() const
+    {
+        return begin().spans_to(end());
+    }
+
+    iterator begin()
+    {
+        return iterator(buf, head, span, 0);
+    }
+    iterator end()
+    {
+        return iterator(buf, head, span, count);
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(buf, head, span, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(buf, head, span, count);
+    }
+
+    ~MirroredDeque()
+    {
+        releaseStorage(buf, capacity, mirrored);
+    }
+};
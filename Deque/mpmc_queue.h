@@ -0,0 +1,224 @@
+#pragma once
+#include "base.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+/*
+ * Bounded multi-producer/multi-consumer FIFO over a power-of-two ring. Every
+ * slot carries a sequence number telling whether it is ready to be written
+ * (sequence == position) or read (sequence == position + 1), so producers and
+ * consumers only contend on their own index with a single CAS.
+ *
+ * try_push/try_pop never block. push/pop spin for a while, then yield, then
+ * park on a condition variable until the other side makes progress.
+ *
+ * The non-blocking paths pay no fence for the parking handshake: after a
+ * successful operation they only do a relaxed load of the other side's waiting
+ * count and take the lock only when someone is parked. That load may miss a
+ * thread that is just parking, so parked threads also wake up every
+ * park_interval and re-check; a lost wakeup costs at most that delay.
+ */
+template <typename T> class MpmcQueue
+{
+    typedef typename aligned_storage<sizeof(T), alignof(T)>::type slot_type;
+
+    struct cell
+    {
+        atomic<size_t> sequence;
+        slot_type data;
+    };
+
+    struct alignas(cache_line_size) parking
+    {
+        atomic<int> waiting;
+        atomic<size_t> epoch;
+        mutex lock;
+        condition_variable cond;
+
+        parking()
+            : waiting(0), epoch(0)
+        {
+        }
+    };
+
+    static const int spin_limit = 64;
+    static const int yield_limit = 16;
+    static constexpr int park_interval_us = 1000;
+
+    cell* cells;
+    size_t mask;
+
+    alignas(cache_line_size) atomic<size_t> enqueue_pos;
+    alignas(cache_line_size) atomic<size_t> dequeue_pos;
+
+    parking producers, consumers;
+
+    static void wake(parking& side)
+    {
+        if (side.waiting.load(memory_order_relaxed) == 0)
+            return;
+        lock_guard<mutex> guard(side.lock);
+        side.epoch.fetch_add(1, memory_order_release);
+        side.cond.notify_one();
+    }
+
+    template <typename TryOp> static void waitFor(TryOp try_op, parking& side)
+    {
+        for (int i = 0; i < spin_limit; i++)
+            if (try_op())
+                return;
+        for (int i = 0; i < yield_limit; i++)
+        {
+            if (try_op())
+                return;
+            this_thread::yield();
+        }
+
+        side.waiting.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        for (;;)
+        {
+            size_t seen = side.epoch.load(memory_order_acquire);
+            if (try_op())
+                break;
+            unique_lock<mutex> guard(side.lock);
+            side.cond.wait_for(guard, chrono::microseconds(park_interval_us),
+                               [&side, seen]() { return side.epoch.load(memory_order_acquire) != seen; });
+        }
+        side.waiting.fetch_sub(1, memory_order_relaxed);
+    }
+
+    cell* claimForPush()
+    {
+        size_t pos = enqueue_pos.load(memory_order_relaxed);
+        for (;;)
+        {
+            cell* c = &cells[pos & mask];
+            size_t seq = c->sequence.load(memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    return c;
+            }
+            else if (dif < 0)
+                return nullptr;
+            else
+                pos = enqueue_pos.load(memory_order_relaxed);
+        }
+    }
+
+    cell* claimForPop()
+    {
+        size_t pos = dequeue_pos.load(memory_order_relaxed);
+        for (;;)
+        {
+            cell* c = &cells[pos & mask];
+            size_t seq = c->sequence.load(memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    return c;
+            }
+            else if (dif < 0)
+                return nullptr;
+            else
+                pos = dequeue_pos.load(memory_order_relaxed);
+        }
+    }
+
+public:
+
+    explicit MpmcQueue(size_t user_capacity)
+        : enqueue_pos(0), dequeue_pos(0)
+    {
+        size_t capacity = 2;
+        while (capacity < user_capacity)
+            capacity <<= 1;
+        mask = capacity - 1;
+        cells = new cell[capacity];
+        for (size_t i = 0; i < capacity; i++)
+            cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue& operator = (const MpmcQueue &) = delete;
+
+    template <typename... Args> bool try_emplace(Args&&... args)
+    {
+        cell* c = claimForPush();
+        if (c == nullptr)
+            return false;
+        size_t pos = c->sequence.load(memory_order_relaxed);
+        new (&c->data) T(forward<Args>(args)...);
+        c->sequence.store(pos + 1, memory_order_release);
+        wake(consumers);
+        return true;
+    }
+
+    bool try_push(const T& obj)
+    {
+        return try_emplace(obj);
+    }
+
+    bool try_push(T&& obj)
+    {
+        return try_emplace(move(obj));
+    }
+
+    bool try_pop(T& obj)
+    {
+        cell* c = claimForPop();
+        if (c == nullptr)
+            return false;
+        size_t pos = c->sequence.load(memory_order_relaxed) - 1;
+        T* src = reinterpret_cast<T*>(&c->data);
+        obj = move(*src);
+        src->~T();
+        c->sequence.store(pos + mask + 1, memory_order_release);
+        wake(producers);
+        return true;
+    }
+
+    void push(const T& obj)
+    {
+        waitFor([this, &obj]() { return try_push(obj); }, producers);
+    }
+
+    void push(T&& obj)
+    {
+        waitFor([this, &obj]() { return try_push(move(obj)); }, producers);
+    }
+
+    void pop(T& obj)
+    {
+        waitFor([this, &obj]() { return try_pop(obj); }, consumers);
+    }
+
+    size_t size_approx() const
+    {
+        size_t enqueued = enqueue_pos.load(memory_order_acquire);
+        size_t dequeued = dequeue_pos.load(memory_order_acquire);
+        return enqueued >= dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t get_capacity() const
+    {
+        return mask + 1;
+    }
+
+    ~MpmcQueue()
+    {
+        size_t end = enqueue_pos.load(memory_order_relaxed);
+        for (size_t pos = dequeue_pos.load(memory_order_relaxed); pos != end; pos++)
+            reinterpret_cast<T*>(&cells[pos & mask].data)->~T();
+        delete[] cells;
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include "base.h"
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Allocator serving buffers of at least ThresholdBytes straight from mmap, so
+ * that Deque can grow them with mremap: the kernel moves page table entries
+ * instead of copying the elements (see deque_trivially_relocatable). Smaller
+ * buffers come from operator new. Off Linux every buffer comes from operator
+ * new and grow_in_place() always declines.
+ */
+template <typename T, size_t ThresholdBytes = (size_t)1 << 20> class mremap_allocator
+{
+    static size_t mappedBytes(size_t n)
+    {
+#if defined(__linux__)
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        return (n * sizeof(T) + page - 1) / page * page;
+#else
+        return n * sizeof(T);
+#endif
+    }
+
+    static bool isMapped(size_t n)
+    {
+#if defined(__linux__)
+        return alignof(T) <= 4096 && n * sizeof(T) >= ThresholdBytes;
+#else
+        (void)n;
+        return false;
+#endif
+    }
+
+public:
+
+    typedef T value_type;
+    typedef true_type is_always_equal;
+    typedef true_type supports_grow_in_place;
+
+    template <typename U> struct rebind
+    {
+        typedef mremap_allocator<U, ThresholdBytes> other;
+    };
+
+    mremap_allocator()
+    {
+    }
+
+    template <typename U> mremap_allocator(const mremap_allocator<U, ThresholdBytes> &)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+#if defined(__linux__)
+        if (isMapped(n))
+        {
+            void* ptr = mmap(nullptr, mappedBytes(n), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                throw bad_alloc();
+            return static_cast<T*>(ptr);
+        }
+#endif
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+#if defined(__linux__)
+        if (isMapped(n))
+        {
+            munmap(ptr, mappedBytes(n));
+            return;
+        }
+#endif
+        ::operator delete(ptr);
+    }
+
+    /*
+     * Resizes a buffer of old_n elements to new_n, keeping the bytes of the
+     * first old_n slots, possibly at a new address. Returns nullptr, leaving the
+     * buffer untouched, when ptr is not an mmap buffer or mremap fails.
+     */
+    T* grow_in_place(T* ptr, size_t old_n, size_t new_n)
+    {
+#if defined(__linux__)
+        if (!isMapped(old_n))
+            return nullptr;
+        void* grown = mremap(ptr, mappedBytes(old_n), mappedBytes(new_n), MREMAP_MAYMOVE);
+        return grown == MAP_FAILED ? nullptr : static_cast<T*>(grown);
+#else
+        (void)ptr;
+        (void)old_n;
+        (void)new_n;
+        return nullptr;
+#endif
+    }
+
+    template <typename U> bool operator == (const mremap_allocator<U, ThresholdBytes> &) const
+    {
+        return true;
+    }
+
+    template <typename U> bool operator != (const mremap_allocator<U, ThresholdBytes> &) const
+    {
+        return false;
+    }
+};
@@ -0,0 +1,251 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+/*
+ * Parallel algorithms over container_iterator ranges. The logical range is cut
+ * into roughly equal chunks that never cross the wrap point of the ring, so
+ * every chunk is a plain pointer range; chunks run as tasks of a ThreadPool
+ * (by default a process-wide pool with one worker per core).
+ */
+
+const size_t parallel_min_chunk = 4096;
+const size_t parallel_merge_grain = 16 * 1024;
+
+inline ThreadPool& default_thread_pool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// A contiguous piece of a ring range: offset is its position in the range, index its position among the pieces.
+template <typename T> struct range_chunk
+{
+    T* first;
+    T* last;
+    size_t offset;
+    size_t index;
+};
+
+template <typename T>
+vector<range_chunk<T> > splitRange(container_iterator<T> first, container_iterator<T> last, size_t parts)
+{
+    pair<ring_span<T>, ring_span<T> > spans = first.spans_to(last);
+    size_t count = (size_t)spans.first.size() + spans.second.size();
+    size_t chunk = max(parallel_min_chunk, (count + parts - 1) / max<size_t>(parts, 1));
+
+    vector<range_chunk<T> > chunks;
+    size_t offset = 0;
+    ring_span<T> parts_list[] = { spans.first, spans.second };
+    for (const ring_span<T>& span : parts_list)
+        for (T* it = span.begin(); it != span.end(); )
+        {
+            T* end = it + min(chunk, (size_t)(span.end() - it));
+            range_chunk<T> piece = { it, end, offset, chunks.size() };
+            chunks.push_back(piece);
+            offset += end - it;
+            it = end;
+        }
+    return chunks;
+}
+
+template <typename T, typename F>
+void runChunks(ThreadPool& pool, const vector<range_chunk<T> >& chunks, F f)
+{
+    if (chunks.empty())
+        return;
+    TaskGroup group(pool);
+    for (size_t i = 1; i < chunks.size(); i++)
+        group.run([&f, &chunks, i]() { f(chunks[i]); });
+    f(chunks[0]);
+    group.wait();
+}
+
+template <typename InputIt, typename OutputIt, typename Compare>
+void parallelMerge(ThreadPool& pool, InputIt a_first, InputIt a_last, InputIt b_first, InputIt b_last,
+                   OutputIt out, Compare comp)
+{
+    size_t a_count = a_last - a_first, b_count = b_last - b_first;
+    if (a_count + b_count <= parallel_merge_grain)
+    {
+        std::merge(make_move_iterator(a_first), make_move_iterator(a_last),
+                   make_move_iterator(b_first), make_move_iterator(b_last), out, comp);
+        return;
+    }
+    if (a_count < b_count)
+    {
+        parallelMerge(pool, b_first, b_last, a_first, a_last, out, comp);
+        return;
+    }
+
+    InputIt a_mid = a_first + a_count / 2;
+    InputIt b_mid = std::lower_bound(b_first, b_last, *a_mid, comp);
+    OutputIt out_mid = out + ((a_mid - a_first) + (b_mid - b_first));
+
+    TaskGroup group(pool);
+    group.run([&pool, a_first, a_mid, b_first, b_mid, out, comp]()
+    {
+        parallelMerge(pool, a_first, a_mid, b_first, b_mid, out, comp);
+    });
+    parallelMerge(pool, a_mid, a_last, b_mid, b_last, out_mid, comp);
+    group.wait();
+}
+
+/*
+ * Merges neighbouring sorted runs (given by their boundaries) from src into
+ * dst, pairwise and in parallel; an odd run at the end is moved as is.
+ */
+template <typename SourceIt, typename DestIt, typename Compare>
+void mergeRuns(ThreadPool& pool, SourceIt src, DestIt dst, vector<size_t>& bounds, Compare comp)
+{
+    vector<size_t> merged(1, 0);
+    TaskGroup group(pool);
+    size_t i = 0;
+    for (; i + 2 < bounds.size(); i += 2)
+    {
+        size_t lo = bounds[i], mid = bounds[i + 1], hi = bounds[i + 2];
+        group.run([&pool, src, dst, lo, mid, hi, comp]()
+        {
+            parallelMerge(pool, src + lo, src + mid, src + mid, src + hi, dst + lo, comp);
+        });
+        merged.push_back(hi);
+    }
+    if (i + 1 < bounds.size())
+    {
+        std::move(src + bounds[i], src + bounds[i + 1], dst + bounds[i]);
+        merged.push_back(bounds[i + 1]);
+    }
+    group.wait();
+    bounds.swap(merged);
+}
+
+template <typename T, typename F>
+void parallel_for_each(ThreadPool& pool, container_iterator<T> first, container_iterator<T> last, F f)
+{
+    runChunks(pool, splitRange(first, last, pool.size() * 4), [&f](const range_chunk<T>& piece)
+    {
+        for (T* it = piece.first; it != piece.last; ++it)
+            f(*it);
+    });
+}
+
+template <typename T, typename F>
+void parallel_for_each(container_iterator<T> first, container_iterator<T> last, F f)
+{
+    parallel_for_each(default_thread_pool(), first, last, f);
+}
+
+/*
+ * out must be a random access iterator to at least last - first elements;
+ * returns the end of the written range.
+ */
+template <typename T, typename OutputIt, typename UnaryOp>
+OutputIt parallel_transform(ThreadPool& pool, container_iterator<T> first, container_iterator<T> last,
+                            OutputIt out, UnaryOp op)
+{
+    runChunks(pool, splitRange(first, last, pool.size() * 4), [&op, out](const range_chunk<T>& piece)
+    {
+        std::transform(piece.first, piece.last, out + piece.offset, op);
+    });
+    return out + (last - first);
+}
+
+template <typename T, typename OutputIt, typename UnaryOp>
+OutputIt parallel_transform(container_iterator<T> first, container_iterator<T> last, OutputIt out, UnaryOp op)
+{
+    return parallel_transform(default_thread_pool(), first, last, out, op);
+}
+
+/*
+ * op must be associative: chunks are reduced independently and the partial
+ * results are then combined in order, starting from init.
+ */
+template <typename T, typename Value, typename BinaryOp>
+Value parallel_reduce(ThreadPool& pool, container_iterator<T> first, container_iterator<T> last,
+                      Value init, BinaryOp op)
+{
+    vector<range_chunk<T> > chunks = splitRange(first, last, pool.size() * 4);
+    vector<Value> partial(chunks.size(), init);
+    runChunks(pool, chunks, [&op, &partial](const range_chunk<T>& piece)
+    {
+        Value value = Value(*piece.first);
+        for (T* it = piece.first + 1; it != piece.last; ++it)
+            value = op(value, *it);
+        partial[piece.index] = value;
+    });
+    return std::accumulate(partial.begin(), partial.end(), init, op);
+}
+
+template <typename T, typename Value, typename BinaryOp>
+Value parallel_reduce(container_iterator<T> first, container_iterator<T> last, Value init, BinaryOp op)
+{
+    return parallel_reduce(default_thread_pool(), first, last, init, op);
+}
+
+template <typename T, typename Value>
+Value parallel_reduce(container_iterator<T> first, container_iterator<T> last, Value init)
+{
+    return parallel_reduce(default_thread_pool(), first, last, init, plus<Value>());
+}
+
+/*
+ * Sorts one chunk per worker in place, then merges the sorted runs in
+ * log(workers) rounds, bouncing between the ring and a scratch vector (so T
+ * must be default constructible). Every merge is itself split in parallel.
+ */
+template <typename T, typename Compare>
+void parallel_sort(ThreadPool& pool, container_iterator<T> first, container_iterator<T> last, Compare comp)
+{
+    vector<range_chunk<T> > chunks = splitRange(first, last, pool.size());
+    if (chunks.size() <= 1)
+    {
+        if (!chunks.empty())
+            std::sort(chunks[0].first, chunks[0].last, comp);
+        return;
+    }
+
+    runChunks(pool, chunks, [&comp](const range_chunk<T>& piece)
+    {
+        std::sort(piece.first, piece.last, comp);
+    });
+
+    size_t count = last - first;
+    vector<size_t> bounds;
+    for (const range_chunk<T>& piece : chunks)
+        bounds.push_back(piece.offset);
+    bounds.push_back(count);
+
+    vector<T> buffer(count);
+    bool in_buffer = false;
+    while (bounds.size() > 2)
+    {
+        if (in_buffer)
+            mergeRuns(pool, buffer.begin(), first, bounds, comp);
+        else
+            mergeRuns(pool, first, buffer.begin(), bounds, comp);
+        in_buffer = !in_buffer;
+    }
+
+    if (in_buffer)
+        runChunks(pool, chunks, [&buffer](const range_chunk<T>& piece)
+        {
+            std::move(buffer.begin() + piece.offset, buffer.begin() + piece.offset + (piece.last - piece.first), piece.first);
+        });
+}
+
+template <typename T, typename Compare>
+void parallel_sort(container_iterator<T> first, container_iterator<T> last, Compare comp)
+{
+    parallel_sort(default_thread_pool(), first, last, comp);
+}
+
+template <typename T>
+void parallel_sort(container_iterator<T> first, container_iterator<T> last)
+{
+    parallel_sort(default_thread_pool(), first, last, less<T>());
+}
@@ -0,0 +1,488 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+const uint persistent_chunk_bytes = 512;
+
+template <typename T> struct persistent_chunk_traits
+{
+    static const uint chunk_size = sizeof(T) * 8 < persistent_chunk_bytes ? persistent_chunk_bytes / sizeof(T) : 8;
+};
+
+/*
+ * Immutable-by-default deque whose copies share structure: copying (or
+ * snapshot()) costs three shared_ptr copies regardless of size, and
+ * versions never observe each other's modifications.
+ *
+ * Elements live in chunks of chunk_size. The two ends are chunk buffers
+ * (the front one stored reversed so both grow by push_back); chunks in between
+ * sit in a persistent, path-copied AVL tree ordered by position, where every
+ * node caches its subtree's element count. A push writes into its end buffer,
+ * copying it first only when another version still shares it, and hands the
+ * buffer to the tree once it is full; a pop only moves the buffer's used
+ * count. The tree is touched once per chunk_size operations, in O(log n), and
+ * operator[] is O(log n).
+ *
+ * Popped elements stay alive until their chunk is released or overwritten.
+ * Distinct versions may be used from different threads; one version is not
+ * safe to modify concurrently.
+ */
+template <typename T> class PersistentDeque
+{
+    static const uint chunk_size = persistent_chunk_traits<T>::chunk_size;
+
+    typedef vector<T> chunk;
+    typedef shared_ptr<chunk> chunk_ptr;
+
+    struct node;
+    typedef shared_ptr<const node> tree;
+
+    struct node
+    {
+        tree left, right;
+        chunk_ptr items;
+        uint count;
+        int height;
+    };
+
+    struct buffer
+    {
+        chunk_ptr items;
+        uint used;
+    };
+
+    buffer front_buf, back_buf;
+    tree middle;
+
+    static uint countOf(const tree& t)
+    {
+        return t ? t->count : 0;
+    }
+
+    static int heightOf(const tree& t)
+    {
+        return t ? t->height : 0;
+    }
+
+    static tree makeNode(const tree& left, const chunk_ptr& items, const tree& right)
+    {
+        shared_ptr<node> result = make_shared<node>();
+        result->left = left;
+        result->right = right;
+        result->items = items;
+        result->count = countOf(left) + (uint)items->size() + countOf(right);
+        result->height = max(heightOf(left), heightOf(right)) + 1;
+        return result;
+    }
+
+    // Joins two subtrees whose heights differ by at most two around items.
+    static tree balance(const tree& left, const chunk_ptr& items, const tree& right)
+    {
+        int hl = heightOf(left), hr = heightOf(right);
+        if (hl > hr + 1)
+        {
+            if (heightOf(left->left) >= heightOf(left->right))
+                return makeNode(left->left, left->items, makeNode(left->right, items, right));
+            const tree& inner = left->right;
+            return makeNode(makeNode(left->left, left->items, inner->left), inner->items,
+                            makeNode(inner->right, items, right));
+        }
+        if (hr > hl + 1)
+        {
+            if (heightOf(right->right) >= heightOf(right->left))
+                return makeNode(makeNode(left, items, right->left), right->items, right->right);
+            const tree& inner = right->left;
+            return makeNode(makeNode(left, items, inner->left), inner->items,
+                            makeNode(inner->right, right->items, right->right));
+        }
+        return makeNode(left, items, right);
+    }
+
+    static tree insertFront(const tree& t, const chunk_ptr& items)
+    {
+        if (!t)
+            return makeNode(tree(), items, tree());
+        return balance(insertFront(t->left, items), t->items, t->right);
+    }
+
+    static tree insertBack(const tree& t, const chunk_ptr& items)
+    {
+        if (!t)
+            return makeNode(tree(), items, tree());
+        return balance(t->left, t->items, insertBack(t->right, items));
+    }
+
+    static tree removeFront(const tree& t, chunk_ptr& items)
+    {
+        if (!t->left)
+        {
+            items = t->items;
+            return t->right;
+        }
+        return balance(removeFront(t->left, items), t->items, t->right);
+    }
+
+    static tree removeBack(const tree& t, chunk_ptr& items)
+    {
+        if (!t->right)
+        {
+            items = t->items;
+            return t->left;
+        }
+        return balance(t->left, t->items, removeBack(t->right, items));
+    }
+
+    static tree build(const vector<chunk_ptr>& chunks, size_t first, size_t last)
+    {
+        if (first == last)
+            return tree();
+        size_t mid = first + (last - first) / 2;
+        return makeNode(build(chunks, first, mid), chunks[mid], build(chunks, mid + 1, last));
+    }
+
+    template <typename F> static void visitTree(const tree& t, F& f)
+    {
+        if (!t)
+            return;
+        visitTree(t->left, f);
+        f(t->items->data(), t->items->data() + t->items->size());
+        visitTree(t->right, f);
+    }
+
+    /*
+     * Makes the buffer writable: its chunk is reused when nobody else holds it
+     * (dropping popped leftovers), and copied otherwise.
+     */
+    static void own(buffer& buf)
+    {
+        if (buf.items && buf.items.use_count() == 1)
+        {
+            // Pairs with the release decrement of the last other owner.
+            atomic_thread_fence(memory_order_acquire);
+            buf.items->erase(buf.items->begin() + buf.used, buf.items->end());
+            return;
+        }
+        chunk_ptr copy = make_shared<chunk>();
+        copy->reserve(chunk_size);
+        if (buf.items)
+            copy->assign(buf.items->begin(), buf.items->begin() + buf.used);
+        buf.items = copy;
+    }
+
+    static chunk_ptr usedPart(const buffer& buf, bool reversed)
+    {
+        if (!reversed && buf.items->size() == buf.used)
+            return buf.items;
+        chunk_ptr result = make_shared<chunk>();
+        if (reversed)
+            result->assign(buf.items->rend() - buf.used, buf.items->rend());
+        else
+            result->assign(buf.items->begin(), buf.items->begin() + buf.used);
+        return result;
+    }
+
+    static buffer reversedBuffer(const chunk& items, uint count)
+    {
+        buffer result;
+        result.items = make_shared<chunk>(items.rend() - count, items.rend());
+        result.used = count;
+        return result;
+    }
+
+    static buffer emptyBuffer()
+    {
+        buffer result;
+        result.used = 0;
+        return result;
+    }
+
+    static buffer sliceBuffer(const chunk& items, uint first, uint last)
+    {
+        buffer result;
+        result.items = make_shared<chunk>(items.begin() + first, items.begin() + last);
+        result.used = last - first;
+        return result;
+    }
+
+    /*
+     * Refills an exhausted end from the tree or, failing that, with the nearer
+     * half of the other end, so pops alternating between the ends of a short
+     * deque stay amortized O(1).
+     */
+    void refillBack()
+    {
+        if (middle)
+        {
+            chunk_ptr items;
+            middle = removeBack(middle, items);
+            back_buf.items = items;
+            back_buf.used = (uint)items->size();
+            return;
+        }
+        uint moved = front_buf.used - front_buf.used / 2;
+        back_buf = reversedBuffer(*front_buf.items, moved);
+        front_buf = sliceBuffer(*front_buf.items, moved, front_buf.used);
+    }
+
+    void refillFront()
+    {
+        if (middle)
+        {
+            chunk_ptr items;
+            middle = removeFront(middle, items);
+            front_buf = reversedBuffer(*items, (uint)items->size());
+            return;
+        }
+        uint moved = back_buf.used - back_buf.used / 2;
+        front_buf = reversedBuffer(*back_buf.items, moved);
+        back_buf = sliceBuffer(*back_buf.items, moved, back_buf.used);
+    }
+
+    // Pointer to the element at index and how many elements follow it contiguously.
+    const T* locate(uint index, uint& run) const
+    {
+        if (index < front_buf.used)
+        {
+            run = 1;
+            return front_buf.items->data() + (front_buf.used - 1 - index);
+        }
+        index -= front_buf.used;
+        if (index >= countOf(middle))
+        {
+            index -= countOf(middle);
+            run = back_buf.used - index;
+            return back_buf.items->data() + index;
+        }
+        const node* cur = middle.get();
+        while (true)
+        {
+            uint left_count = countOf(cur->left);
+            if (index < left_count)
+            {
+                cur = cur->left.get();
+                continue;
+            }
+            index -= left_count;
+            uint here = (uint)cur->items->size();
+            if (index < here)
+            {
+                run = here - index;
+                return cur->items->data() + index;
+            }
+            index -= here;
+            cur = cur->right.get();
+        }
+    }
+
+public:
+
+    class const_iterator
+    {
+        const PersistentDeque* owner;
+        uint pos, run;
+        const T* ptr;
+
+        void seek()
+        {
+            ptr = pos < owner->size() ? owner->locate(pos, run) : nullptr;
+        }
+
+    public:
+
+        typedef forward_iterator_tag iterator_category;
+        typedef T                    value_type;
+        typedef ptrdiff_t            difference_type;
+        typedef const T*             pointer;
+        typedef const T&             reference;
+
+        const_iterator(const PersistentDeque* n_owner, uint position)
+            : owner(n_owner), pos(position), run(0)
+        {
+            seek();
+        }
+
+        const T& operator *() const
+        {
+            return *ptr;
+        }
+
+        const T* operator ->() const
+        {
+            return ptr;
+        }
+
+        const_iterator& operator ++()
+        {
+            pos++;
+            if (--run != 0)
+                ptr++;
+            else
+                seek();
+            return *this;
+        }
+
+        const_iterator operator ++(int)
+        {
+            const_iterator old(*this);
+            ++*this;
+            return old;
+        }
+
+        bool operator == (const const_iterator &it) const
+        {
+            return pos == it.pos;
+        }
+
+        bool operator != (const const_iterator &it) const
+        {
+            return pos != it.pos;
+        }
+    };
+
+    typedef const_iterator iterator;
+
+    PersistentDeque()
+        : front_buf(emptyBuffer()), back_buf(emptyBuffer())
+    {
+    }
+
+    template <typename Allocator, typename GrowthPolicy, uint InlineCapacity>
+    explicit PersistentDeque(const Deque<T, Allocator, GrowthPolicy, InlineCapacity>& deque)
+        : front_buf(emptyBuffer()), back_buf(emptyBuffer())
+    {
+        vector<chunk_ptr> chunks;
+        chunk_ptr current;
+        deque.for_each_segment([&](const T* first, const T* last)
+        {
+            for (; first != last; ++first)
+            {
+                if (!current || current->size() == chunk_size)
+                {
+                    current = make_shared<chunk>();
+                    current->reserve(chunk_size);
+                    chunks.push_back(current);
+                }
+                current->push_back(*first);
+            }
+        });
+        middle = build(chunks, 0, chunks.size());
+    }
+
+    // O(1): the returned version shares every chunk with this one.
+    PersistentDeque snapshot() const
+    {
+        return *this;
+    }
+
+    uint size() const
+    {
+        return front_buf.used + countOf(middle) + back_buf.used;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    void clear()
+    {
+        front_buf = back_buf = emptyBuffer();
+        middle.reset();
+    }
+
+    void push_back(const T& obj)
+    {
+        if (back_buf.used == chunk_size)
+        {
+            middle = insertBack(middle, usedPart(back_buf, false));
+            back_buf = emptyBuffer();
+        }
+        own(back_buf);
+        back_buf.items->push_back(obj);
+        back_buf.used++;
+    }
+
+    void push_front(const T& obj)
+    {
+        if (front_buf.used == chunk_size)
+        {
+            middle = insertFront(middle, usedPart(front_buf, true));
+            front_buf = emptyBuffer();
+        }
+        own(front_buf);
+        front_buf.items->push_back(obj);
+        front_buf.used++;
+    }
+
+    void pop_back()
+    {
+        if (empty())
+            throw new exception();
+        if (back_buf.used == 0)
+            refillBack();
+        back_buf.used--;
+    }
+
+    void pop_front()
+    {
+        if (empty())
+            throw new exception();
+        if (front_buf.used == 0)
+            refillFront();
+        front_buf.used--;
+    }
+
+    const T& front() const
+    {
+        return operator[](0);
+    }
+
+    const T& back() const
+    {
+        return operator[](size() - 1);
+    }
+
+    const T& operator[] (int index) const
+    {
+        if (index < 0 || index >= (int)size())
+            throw new exception();
+        uint run;
+        return *locate(index, run);
+    }
+
+    // Calls f(first, last) for every contiguous run of elements, in order.
+    template <typename F> void for_each_segment(F f) const
+    {
+        for (uint i = front_buf.used; i-- > 0; )
+            f(front_buf.items->data() + i, front_buf.items->data() + i + 1);
+        visitTree(middle, f);
+        if (back_buf.used != 0)
+            f(back_buf.items->data(), back_buf.items->data() + back_buf.used);
+    }
+
+    Deque<T> to_deque() const
+    {
+        Deque<T> result;
+        for_each_segment([&](const T* first, const T* last)
+        {
+            result.append(first, last);
+        });
+        return result;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, size());
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+#include "base.h"
+#include <cstddef>
+#include <new>
+
+/*
+ * Cache of power-of-two sized buffers. Released buffers are kept on a free list
+ * per size class and handed out again without touching the global heap, up to
+ * max_cached_bytes in total. A pool is not synchronized: use one per thread
+ * (buffer_pool::local()) or guard a shared one externally.
+ */
+class buffer_pool
+{
+    static const uint min_class = 4;
+    static const uint class_count = 28;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    free_block* free_lists[class_count];
+    size_t cached_bytes, max_cached_bytes;
+    size_t hits, misses;
+
+    static uint classOf(size_t bytes)
+    {
+        uint cls = 0;
+        while (((size_t)1 << (cls + min_class)) < bytes)
+            cls++;
+        return cls;
+    }
+
+    static size_t classBytes(uint cls)
+    {
+        return (size_t)1 << (cls + min_class);
+    }
+
+public:
+
+    explicit buffer_pool(size_t max_cached = (size_t)64 << 20)
+        : cached_bytes(0), max_cached_bytes(max_cached), hits(0), misses(0)
+    {
+        fori(i, class_count)
+            free_lists[i] = nullptr;
+    }
+
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool& operator = (const buffer_pool &) = delete;
+
+    void* allocate(size_t bytes)
+    {
+        uint cls = classOf(bytes);
+        if (cls >= class_count)
+            return ::operator new(bytes);
+
+        free_block* block = free_lists[cls];
+        if (block != nullptr)
+        {
+            free_lists[cls] = block->next;
+            cached_bytes -= classBytes(cls);
+            hits++;
+            return block;
+        }
+        misses++;
+        return ::operator new(classBytes(cls));
+    }
+
+    void deallocate(void* ptr, size_t bytes)
+    {
+        uint cls = classOf(bytes);
+        if (cls >= class_count || cached_bytes + classBytes(cls) > max_cached_bytes)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        free_block* block = static_cast<free_block*>(ptr);
+        block->next = free_lists[cls];
+        free_lists[cls] = block;
+        cached_bytes += classBytes(cls);
+    }
+
+    void release()
+    {
+        fori(i, class_count)
+        {
+            while (free_lists[i] != nullptr)
+            {
+                free_block* next = free_lists[i]->next;
+                ::operator delete(free_lists[i]);
+                free_lists[i] = next;
+            }
+        }
+        cached_bytes = 0;
+    }
+
+    size_t cached() const
+    {
+        return cached_bytes;
+    }
+
+    size_t hit_count() const
+    {
+        return hits;
+    }
+
+    size_t miss_count() const
+    {
+        return misses;
+    }
+
+    static buffer_pool& local()
+    {
+        thread_local buffer_pool pool;
+        return pool;
+    }
+
+    ~buffer_pool()
+    {
+        release();
+    }
+};
+
+/*
+ * Allocator drawing from a buffer_pool. A default constructed one uses the
+ * pool of whichever thread calls allocate or deallocate, so containers may
+ * move between threads and outlive the thread that created them. A pool given
+ * explicitly is used from every thread and must be guarded by the caller.
+ * Buffers of every pool are plain operator new blocks, so any two
+ * pool_allocators may free each other's memory and always compare equal.
+ */
+template <typename T> class pool_allocator
+{
+    template <typename U> friend class pool_allocator;
+
+    buffer_pool* pool;
+
+    // nullptr stands for buffer_pool::local() of the calling thread.
+    buffer_pool& currentPool() const
+    {
+        return pool != nullptr ? *pool : buffer_pool::local();
+    }
+
+public:
+
+    typedef T value_type;
+    typedef true_type is_always_equal;
+
+    pool_allocator()
+        : pool(nullptr)
+    {
+    }
+
+    explicit pool_allocator(buffer_pool & user_pool)
+        : pool(&user_pool)
+    {
+    }
+
+    template <typename U> pool_allocator(const pool_allocator<U> & obj)
+        : pool(obj.pool)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (alignof(T) > alignof(max_align_t))
+            return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(alignof(T))));
+        return static_cast<T*>(currentPool().allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        if (alignof(T) > alignof(max_align_t))
+            ::operator delete(ptr, align_val_t(alignof(T)));
+        else
+            currentPool().deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U> bool operator == (const pool_allocator<U> &) const
+    {
+        return true;
+    }
+
+    template <typename U> bool operator != (const pool_allocator<U> &) const
+    {
+        return false;
+    }
+};
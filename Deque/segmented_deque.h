@@ -0,0 +1,460 @@
+#pragma once
+#include "base.h"
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+const uint segment_bytes = 4096;
+const uint base_map_size = 8;
+
+template <typename T> struct segment_traits
+{
+    static const uint block_size = sizeof(T) < segment_bytes ? segment_bytes / sizeof(T) : 1;
+};
+
+template <typename T, typename Allocator = allocator<T> > class SegmentedDeque;
+
+template <typename IteratorType> class segmented_iterator
+{
+private:
+
+    static const uint block_size = segment_traits<IteratorType>::block_size;
+
+    IteratorType* const* map;
+    int pos;
+
+public:
+
+    typedef random_access_iterator_tag                   iterator_category;
+    typedef typename remove_const<IteratorType>::type    value_type;
+    typedef ptrdiff_t                                    difference_type;
+    typedef IteratorType*                                pointer;
+    typedef IteratorType&                                reference;
+
+    segmented_iterator(IteratorType* const* n_map, int position)
+        : map(n_map), pos(position)
+    {
+    }
+
+    IteratorType& operator *() const
+    {
+        return map[(uint)pos / block_size][(uint)pos % block_size];
+    }
+
+    IteratorType* operator ->() const
+    {
+        return &**this;
+    }
+
+    segmented_iterator operator++(int)
+    {
+        segmented_iterator new_it(*this);
+        pos++;
+        return new_it;
+    }
+
+    segmented_iterator& operator++()
+    {
+        pos++;
+        return *this;
+    }
+
+    segmented_iterator& operator -- ()
+    {
+        pos--;
+        return *this;
+    }
+
+    segmented_iterator operator -- (int)
+    {
+        segmented_iterator new_it(*this);
+        pos--;
+        return new_it;
+    }
+
+    segmented_iterator operator + (int f) const
+    {
+        return segmented_iterator(map, pos + f);
+    }
+
+    segmented_iterator operator - (int f) const
+    {
+        return segmented_iterator(map, pos - f);
+    }
+
+    int operator - (const segmented_iterator& it) const
+    {
+        return pos - it.pos;
+    }
+
+    segmented_iterator& operator += (int f)
+    {
+        pos += f;
+        return *this;
+    }
+
+    segmented_iterator& operator -= (int f)
+    {
+        pos -= f;
+        return *this;
+    }
+
+    IteratorType& operator [] (int f) const
+    {
+        return *(*this + f);
+    }
+
+    bool operator != (const segmented_iterator &it) const
+    {
+        return pos != it.pos;
+    }
+
+    bool operator == (const segmented_iterator &it) const
+    {
+        return pos == it.pos;
+    }
+
+    bool operator < (const segmented_iterator &it) const
+    {
+        return pos < it.pos;
+    }
+
+    bool operator > (const segmented_iterator &it) const
+    {
+        return pos > it.pos;
+    }
+
+    bool operator >= (const segmented_iterator &it) const
+    {
+        return pos >= it.pos;
+    }
+
+    bool operator <= (const segmented_iterator &it) const
+    {
+        return pos <= it.pos;
+    }
+};
+
+/*
+ * Deque over fixed-size blocks addressed through a map of block pointers.
+ * Growth allocates one block at a time and only moves pointers inside the map,
+ * so elements are never copied and references stay valid across push_front
+ * and push_back. Iterators are invalidated whenever the map is re-centered.
+ * Blocks are raw storage from Allocator: elements are constructed in place on
+ * push and destroyed on pop, so T needs no default constructor.
+ */
+template <typename T, typename Allocator> class SegmentedDeque
+{
+    typedef allocator_traits<Allocator> alloc_traits;
+
+    static const uint block_size = segment_traits<T>::block_size;
+
+    Allocator alloc;
+    vector<T*> map;
+    uint start, count;
+
+    uint blockOf(uint position) const
+    {
+        return position / block_size;
+    }
+
+    T& getAt(int index) const
+    {
+        uint position = start + index;
+        return map[blockOf(position)][position % block_size];
+    }
+
+    void ensureBlock(uint block)
+    {
+        if (map[block] == nullptr)
+            map[block] = alloc_traits::allocate(alloc, block_size);
+    }
+
+    void releaseBlock(uint block)
+    {
+        if (block < map.size() && map[block] != nullptr)
+        {
+            alloc_traits::deallocate(alloc, map[block], block_size);
+            map[block] = nullptr;
+        }
+    }
+
+    void destroyElements()
+    {
+        if (is_trivially_destructible<T>::value)
+            return;
+        for (uint i = 0; i < count; i++)
+            alloc_traits::destroy(alloc, &getAt(i));
+    }
+
+    void releaseAll()
+    {
+        destroyElements();
+        for (uint i = 0; i < map.size(); i++)
+            releaseBlock(i);
+    }
+
+    void recenterMap()
+    {
+        uint first = blockOf(start);
+        uint last = min(blockOf(start + count) + 1, (uint)map.size());
+        if (first > last)
+            first = last;
+        for (uint i = 0; i < map.size(); i++)
+            if (i < first || i >= last)
+                releaseBlock(i);
+        uint used = last - first;
+
+        uint new_size = (uint)map.size();
+        if ((used + 2) * 2 > new_size)
+            new_size = max(new_size << 1, (used + 2) << 1);
+        uint new_first = (new_size - used) / 2;
+
+        vector<T*> new_map(new_size, nullptr);
+        for (uint i = 0; i < used; i++)
+            new_map[new_first + i] = map[first + i];
+        map.swap(new_map);
+
+        start = start - first * block_size + new_first * block_size;
+    }
+
+    void copyFrom(const SegmentedDeque & obj)
+    {
+        map.assign(base_map_size, nullptr);
+        start = (base_map_size / 2) * block_size;
+        count = 0;
+        for (uint i = 0; i < obj.count; i++)
+            push_back(obj.getAt(i));
+    }
+
+public:
+
+    typedef segmented_iterator<T>       iterator;
+    typedef segmented_iterator<const T> const_iterator;
+
+    typedef std::reverse_iterator<const_iterator>  const_reverse_iterator;
+    typedef std::reverse_iterator<iterator>        reverse_iterator;
+
+    typedef Allocator allocator_type;
+
+    SegmentedDeque()
+        : map(base_map_size, nullptr), start((base_map_size / 2) * block_size), count(0)
+    {
+    }
+
+    explicit SegmentedDeque(const Allocator & user_alloc)
+        : alloc(user_alloc), map(base_map_size, nullptr), start((base_map_size / 2) * block_size), count(0)
+    {
+    }
+
+    SegmentedDeque(const SegmentedDeque & obj)
+        : alloc(alloc_traits::select_on_container_copy_construction(obj.alloc))
+    {
+        copyFrom(obj);
+    }
+
+    SegmentedDeque(SegmentedDeque && obj)
+        : alloc(obj.alloc), map(base_map_size, nullptr), start((base_map_size / 2) * block_size), count(0)
+    {
+        map.swap(obj.map);
+        swap(start, obj.start);
+        swap(count, obj.count);
+    }
+
+    SegmentedDeque& operator = (const SegmentedDeque & obj)
+    {
+        if (this != &obj)
+        {
+            releaseAll();
+            copyFrom(obj);
+        }
+        return *this;
+    }
+
+    // The old contents go to obj together with the allocator that owns them.
+    SegmentedDeque& operator = (SegmentedDeque && obj)
+    {
+        swap(alloc, obj.alloc);
+        map.swap(obj.map);
+        swap(start, obj.start);
+        swap(count, obj.count);
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    int size() const
+    {
+        return (int)count;
+    }
+
+    void clear()
+    {
+        releaseAll();
+        map.assign(base_map_size, nullptr);
+        start = (base_map_size / 2) * block_size;
+        count = 0;
+    }
+
+    allocator_type get_allocator() const
+    {
+        return alloc;
+    }
+
+    template <typename... Args> T& emplace_back(Args&&... args)
+    {
+        if (blockOf(start + count) >= map.size())
+            recenterMap();
+        uint position = start + count;
+        ensureBlock(blockOf(position));
+        T* slot = map[blockOf(position)] + position % block_size;
+        alloc_traits::construct(alloc, slot, forward<Args>(args)...);
+        count++;
+        return *slot;
+    }
+
+    template <typename... Args> T& emplace_front(Args&&... args)
+    {
+        if (start == 0)
+            recenterMap();
+        uint position = start - 1;
+        ensureBlock(blockOf(position));
+        T* slot = map[blockOf(position)] + position % block_size;
+        alloc_traits::construct(alloc, slot, forward<Args>(args)...);
+        start = position;
+        count++;
+        return *slot;
+    }
+
+    void push_back(const T& obj)
+    {
+        emplace_back(obj);
+    }
+
+    void push_back(T&& obj)
+    {
+        emplace_back(move(obj));
+    }
+
+    void push_front(const T& obj)
+    {
+        emplace_front(obj);
+    }
+
+    void push_front(T&& obj)
+    {
+        emplace_front(move(obj));
+    }
+
+    void pop_back()
+    {
+        count--;
+        alloc_traits::destroy(alloc, &getAt(count));
+        releaseBlock(blockOf(start + count) + 2);
+    }
+
+    void pop_front()
+    {
+        alloc_traits::destroy(alloc, &getAt(0));
+        start++;
+        count--;
+        if (blockOf(start) >= 2)
+            releaseBlock(blockOf(start) - 2);
+    }
+
+    const T back()
+    {
+        return operator[](size() - 1);
+    }
+
+    const T back() const
+    {
+        return operator[](size() - 1);
+    }
+
+    const T front()
+    {
+        return operator[](0);
+    }
+
+    const T front() const
+    {
+        return operator[](0);
+    }
+
+    T& operator[] (int index)
+    {
+        if (index < 0 || index >= size())
+            throw new exception();
+        return getAt(index);
+    }
+
+    const T& operator[] (int index) const
+    {
+        if (index < 0 || index >= size())
+            throw new exception();
+        return getAt(index);
+    }
+
+    iterator begin()
+    {
+        return iterator(map.data(), start);
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(map.data(), start);
+    }
+    iterator end()
+    {
+        return iterator(map.data(), start + count);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(map.data(), start + count);
+    }
+
+    const_iterator cbegin() const
+    {
+        return begin();
+    }
+    const_iterator cend() const
+    {
+        return end();
+    }
+
+    reverse_iterator rbegin()
+    {
+        return reverse_iterator(end());
+    }
+    const_reverse_iterator rbegin() const
+    {
+        return const_reverse_iterator(end());
+    }
+    reverse_iterator rend()
+    {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rend() const
+    {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const
+    {
+        return rbegin();
+    }
+    const_reverse_iterator crend() const
+    {
+        return rend();
+    }
+
+    ~SegmentedDeque()
+    {
+        releaseAll();
+    }
+};
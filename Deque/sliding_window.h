@@ -0,0 +1,210 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include <functional>
+#include <utility>
+
+/*
+ * Sliding-window aggregators over a Deque. Every element is pushed with a
+ * key, which must not decrease from one push to the next: a sequence number
+ * for count-based windows or a timestamp for time-based ones.
+ * evict_until(key) drops every element whose key is smaller than key, and
+ * query() returns the aggregate of what is left. Each operation is amortized
+ * O(1).
+ */
+
+/*
+ * Min (or, with greater<T>, max) of the window. Only the elements that can
+ * still become the answer are kept, in the order of the keys and increasing
+ * according to Compare, so the answer is always at the front.
+ */
+template <typename T, typename Compare = less<T>, typename Key = long long> class MonotonicWindow
+{
+    Deque<pair<Key, T> > candidates;
+    Compare comp;
+
+public:
+
+    explicit MonotonicWindow(const Compare & user_comp = Compare())
+        : comp(user_comp)
+    {
+    }
+
+    void push(const Key& key, const T& value)
+    {
+        while (!candidates.empty() && !comp(candidates[candidates.size() - 1].second, value))
+            candidates.pop_back();
+        candidates.push_back(make_pair(key, value));
+    }
+
+    void evict_until(const Key& key)
+    {
+        while (!candidates.empty() && candidates[0].first < key)
+            candidates.pop_front();
+    }
+
+    // Throws on an empty window, like Deque::operator[] does for a bad index.
+    const T& query() const
+    {
+        return candidates[0].second;
+    }
+
+    bool empty() const
+    {
+        return candidates.empty();
+    }
+
+    void clear()
+    {
+        candidates.clear();
+    }
+};
+
+template <typename T, typename Key = long long>
+using MinWindow = MonotonicWindow<T, less<T>, Key>;
+
+template <typename T, typename Key = long long>
+using MaxWindow = MonotonicWindow<T, greater<T>, Key>;
+
+/*
+ * Running aggregate for an invertible operation (sum, xor, product of
+ * non-zero values...): pushing applies Op, evicting applies Inverse.
+ */
+template <typename T, typename Op = plus<T>, typename Inverse = minus<T>, typename Key = long long>
+class InvertibleWindow
+{
+    Deque<pair<Key, T> > items;
+    T identity, total;
+    Op op;
+    Inverse inverse;
+
+public:
+
+    explicit InvertibleWindow(const T& user_identity = T(), const Op & user_op = Op(),
+                              const Inverse & user_inverse = Inverse())
+        : identity(user_identity), total(user_identity), op(user_op), inverse(user_inverse)
+    {
+    }
+
+    void push(const Key& key, const T& value)
+    {
+        items.push_back(make_pair(key, value));
+        total = op(total, value);
+    }
+
+    void evict_until(const Key& key)
+    {
+        while (!items.empty() && items[0].first < key)
+        {
+            total = inverse(total, items[0].second);
+            items.pop_front();
+        }
+    }
+
+    const T& query() const
+    {
+        return total;
+    }
+
+    int size() const
+    {
+        return items.size();
+    }
+
+    bool empty() const
+    {
+        return items.empty();
+    }
+
+    void clear()
+    {
+        items.clear();
+        total = identity;
+    }
+};
+
+template <typename T, typename Key = long long>
+using SumWindow = InvertibleWindow<T, plus<T>, minus<T>, Key>;
+
+/*
+ * Aggregate for any associative operation with an identity, invertible or
+ * not (max over pairs, gcd, matrix product...). The Deque is split into a
+ * front stack [0, split), where every entry caches the aggregate of itself
+ * and everything after it up to split, and a back stack whose aggregate is
+ * kept in back_total. Evicting from an empty front stack turns the whole back
+ * stack into the front one in a single pass. Op is applied in window order,
+ * so it need not be commutative.
+ */
+template <typename T, typename Op, typename Key = long long> class TwoStackWindow
+{
+    struct entry
+    {
+        Key key;
+        T value, suffix;
+    };
+
+    Deque<entry> items;
+    int split;
+    T identity, back_total;
+    Op op;
+
+    void flip()
+    {
+        T suffix = identity;
+        for (int i = items.size() - 1; i >= 0; i--)
+        {
+            entry& e = items[i];
+            suffix = op(e.value, suffix);
+            e.suffix = suffix;
+        }
+        split = items.size();
+        back_total = identity;
+    }
+
+public:
+
+    explicit TwoStackWindow(const T& user_identity, const Op & user_op = Op())
+        : split(0), identity(user_identity), back_total(user_identity), op(user_op)
+    {
+    }
+
+    void push(const Key& key, const T& value)
+    {
+        entry e = { key, value, identity };
+        items.push_back(e);
+        back_total = op(back_total, value);
+    }
+
+    void evict_until(const Key& key)
+    {
+        while (!items.empty() && items[0].key < key)
+        {
+            if (split == 0)
+                flip();
+            items.pop_front();
+            split--;
+        }
+    }
+
+    T query() const
+    {
+        return split == 0 ? back_total : op(items[0].suffix, back_total);
+    }
+
+    int size() const
+    {
+        return items.size();
+    }
+
+    bool empty() const
+    {
+        return items.empty();
+    }
+
+    void clear()
+    {
+        items.clear();
+        split = 0;
+        back_total = identity;
+    }
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include "base.h"
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+/*
+ * Bounded single-producer/single-consumer ring using the same power-of-two
+ * masked indexing as Deque. Head and tail grow monotonically and live on
+ * separate cache lines; each side keeps a cached copy of the other side's
+ * index and only re-reads the shared one when the cached value says the ring
+ * is full (producer) or empty (consumer). Exactly one thread may push and one
+ * thread may pop at a time.
+ */
+template <typename T> class alignas(cache_line_size) SpscDeque
+{
+    typedef typename aligned_storage<sizeof(T), alignof(T)>::type slot_type;
+
+    slot_type* slots;
+    size_t capacity, mask;
+
+    alignas(cache_line_size) atomic<size_t> tail;
+    size_t cached_head;
+
+    alignas(cache_line_size) atomic<size_t> head;
+    size_t cached_tail;
+
+    T* slot(size_t index) const
+    {
+        return reinterpret_cast<T*>(slots + (index & mask));
+    }
+
+    size_t freeSlots(size_t t, size_t wanted)
+    {
+        size_t free_slots = capacity - (t - cached_head);
+        if (free_slots < wanted)
+        {
+            cached_head = head.load(memory_order_acquire);
+            free_slots = capacity - (t - cached_head);
+        }
+        return free_slots;
+    }
+
+    size_t readySlots(size_t h, size_t wanted)
+    {
+        size_t ready = cached_tail - h;
+        if (ready < wanted)
+        {
+            cached_tail = tail.load(memory_order_acquire);
+            ready = cached_tail - h;
+        }
+        return ready;
+    }
+
+public:
+
+    explicit SpscDeque(size_t user_capacity)
+        : tail(0), cached_head(0), head(0), cached_tail(0)
+    {
+        capacity = 2;
+        while (capacity < user_capacity)
+            capacity <<= 1;
+        mask = capacity - 1;
+        slots = new slot_type[capacity];
+    }
+
+    SpscDeque(const SpscDeque &) = delete;
+    SpscDeque& operator = (const SpscDeque &) = delete;
+
+    template <typename... Args> bool try_emplace(Args&&... args)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (freeSlots(t, 1) == 0)
+            return false;
+        new (slot(t)) T(forward<Args>(args)...);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& obj)
+    {
+        return try_emplace(obj);
+    }
+
+    bool try_push(T&& obj)
+    {
+        return try_emplace(move(obj));
+    }
+
+    bool try_pop(T& obj)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (readySlots(h, 1) == 0)
+            return false;
+        T* src = slot(h);
+        obj = move(*src);
+        src->~T();
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    template <typename InputIt> size_t try_push_n(InputIt first, size_t count)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        size_t n = min(count, freeSlots(t, count));
+        for (size_t i = 0; i < n; i++, ++first)
+            new (slot(t + i)) T(*first);
+        tail.store(t + n, memory_order_release);
+        return n;
+    }
+
+    template <typename OutputIt> size_t try_pop_n(OutputIt out, size_t max_count)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        size_t n = min(max_count, readySlots(h, max_count));
+        for (size_t i = 0; i < n; i++, ++out)
+        {
+            T* src = slot(h + i);
+            *out = move(*src);
+            src->~T();
+        }
+        head.store(h + n, memory_order_release);
+        return n;
+    }
+
+    size_t size_approx() const
+    {
+        size_t t = tail.load(memory_order_acquire);
+        size_t h = head.load(memory_order_acquire);
+        return t >= h ? t - h : 0;
+    }
+
+    bool empty() const
+    {
+        return size_approx() == 0;
+    }
+
+    size_t get_capacity() const
+    {
+        return capacity;
+    }
+
+    ~SpscDeque()
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        for (size_t h = head.load(memory_order_relaxed); h != t; h++)
+            slot(h)->~T();
+        delete[] slots;
+    }
+};
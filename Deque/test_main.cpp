@@ -1,9 +1,37 @@
+#ifdef _MSC_VER
 #include <vld.h>
+#endif
 #include <gtest/gtest.h>
 #include <random>
 #include <chrono>
+#include <deque>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "base.h"
 #include "deque.h"
+#include "deque_algorithm.h"
+#include "segmented_deque.h"
+#include "pool_allocator.h"
+#include "mremap_allocator.h"
+#include "spsc_deque.h"
+#include "mpmc_queue.h"
+#include "work_stealing_deque.h"
+#include "thread_pool.h"
+#include "blocking_deque.h"
+#include "parallel_algorithm.h"
+#include "deque_simd.h"
+#include "circular_buffer.h"
+#include "sliding_window.h"
+#include "mapped_deque.h"
+#include "deque_io.h"
+#include "persistent_deque.h"
+#include "mirrored_deque.h"
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#endif
 
 class DequeTest : public ::testing::Test
 {
@@ -227,44 +255,25 @@ TEST_F(DequeTest, Correct_size)
     EXPECT_EQ(maxn, count);
 }
 
-TEST_F(DequeTest, LinearTime_1e6)
+TEST_F(DequeTest, PushPopBack_1e6)
 {
-    chrono::steady_clock clock;
-
     int maxn = 1000 * 1000;
 
-    vector<int> vector_int;
-
     for (int size = 10; size <= maxn; size *= 10)
     {
-        auto before_deque_push = clock.now();
         fori(i, size)
-            deque_int.push_back(random(engine));
+            deque_int.push_back(i);
+        EXPECT_EQ(size, deque_int.size());
+        int expected = size;
+        bool ordered = true;
         while (!deque_int.empty())
+        {
+            ordered = ordered && deque_int.back() == --expected;
             deque_int.pop_back();
-        auto deque_after_pop_back = clock.now();
-
-        
-
-        auto before_vector_push = clock.now();
-        fori(i, size)
-            vector_int.push_back(random(engine));
-        while (!deque_int.empty())
-            vector_int.pop_back();
-        auto vector_after_pop_back = clock.now();
-
-        auto deque_duration = deque_after_pop_back - before_deque_push;
-        auto vector_duration = vector_after_pop_back - before_vector_push;
-
-        cerr << endl;
-        cerr << "Size = " << to_string(size) << endl;
-        cerr << "deque_duration / vector_duration = " << deque_duration.count() / (double)vector_duration.count() << endl;
-        cerr << "deque_time = " << deque_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << "vector_time = " << vector_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << "relative_time = " << deque_duration.count() / (double)size / (1000 * 1000.0) << " ms" << endl;
-        cerr << endl;
+        }
+        EXPECT_TRUE(ordered);
+        EXPECT_EQ(0, expected);
     }
-    cerr << endl;
 }
 
 TEST_F(DequeTest, ReverseDeque_small)
@@ -308,26 +317,8 @@ TEST_F(DequeTest, SortDeque)
 
         EXPECT_EQ(temp_v.size(), deque_int.size());
 
-        chrono::steady_clock clock;
-
-        auto before_vector_sort = clock.now();
         sort(temp_v.begin(), temp_v.end());
-        auto after_vector_sort = clock.now();
-
-        auto before_deque_sort = clock.now();
         sort(deque_int.begin(), deque_int.end());
-        auto after_deque_sort = clock.now();
-
-        auto deque_duration = after_deque_sort - before_deque_sort;
-        auto vector_duration = after_vector_sort - before_vector_sort;
-
-        cerr << endl;
-        cerr << "Size = " << to_string(size) << endl;
-        cerr << "deque_duration / vector_duration = " << deque_duration.count() / (double)vector_duration.count() << endl;
-        cerr << "deque_time = " << deque_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << "vector_time = " << vector_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << endl;
-        
 
         EXPECT_EQ(temp_v.size(), deque_int.size());
 
@@ -339,7 +330,6 @@ TEST_F(DequeTest, SortDeque)
         }
         EXPECT_EQ(temp_v.size(), deque_int.size());
     }
-    cerr << endl;
 }
 
 TEST_F(DequeTest, SortDeque_ReverseOrder)
@@ -359,25 +349,8 @@ TEST_F(DequeTest, SortDeque_ReverseOrder)
 
         EXPECT_EQ(temp_v.size(), deque_int.size());
 
-        chrono::steady_clock clock;
-
-        auto before_vector_sort = clock.now();
         sort(temp_v.rbegin(), temp_v.rend());
-        auto after_vector_sort = clock.now();
-
-        auto before_deque_sort = clock.now();
         sort(deque_int.rbegin(), deque_int.rend());
-        auto after_deque_sort = clock.now();
-
-        auto deque_duration = after_deque_sort - before_deque_sort;
-        auto vector_duration = after_vector_sort - before_vector_sort;
-
-        cerr << endl;
-        cerr << "Size = " << to_string(size) << endl;
-        cerr << "deque_duration / vector_duration = " << deque_duration.count() / (double)vector_duration.count() << endl;
-        cerr << "deque_time = " << deque_duration.count() / (1000*1000.0) << " ms" << endl;
-        cerr << "vector_time = " << vector_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << endl;
 
         EXPECT_EQ(temp_v.size(), deque_int.size());
 
@@ -389,47 +362,2091 @@ TEST_F(DequeTest, SortDeque_ReverseOrder)
         }
         EXPECT_EQ(temp_v.size(), deque_int.size());
     }
-    cerr << endl;
 }
 
-TEST_F(DequeTest, LinearTime_1e6_clear_inside)
+TEST_F(DequeTest, PushBackClear_1e6)
 {
-    chrono::steady_clock clock;
-
     int maxn = 1000 * 1000;
 
-    vector<int> vector_int;
-
     for (int size = 10; size <= maxn; size *= 10)
     {
-        auto before_deque_push = clock.now();
         fori(i, size)
             deque_int.push_back(random(engine));
+        EXPECT_EQ(size, deque_int.size());
         deque_int.clear();
-        auto deque_after_pop_back = clock.now();
+        EXPECT_TRUE(deque_int.empty());
+        EXPECT_EQ(deque_int.begin(), deque_int.end());
+    }
+}
 
+TEST_F(DequeTest, RangeAppendPrepend)
+{
+    vector<int> v;
+    fori(i, 1000)
+        v.push_back(i);
+
+    deque_int.push_back(-1);
+    deque_int.append(v.data(), v.data() + v.size());
+    deque_int.prepend(v.begin(), v.begin() + 500);
+    EXPECT_EQ(1501, deque_int.size());
+    fori(i, 500)
+        EXPECT_EQ(i, deque_int[i]);
+    EXPECT_EQ(-1, deque_int[500]);
+    fori(i, 1000)
+        EXPECT_EQ(i, deque_int[501 + i]);
+
+    Deque<int> copy(deque_int.begin(), deque_int.end());
+    EXPECT_TRUE(equal(deque_int.begin(), deque_int.end(), copy.begin()));
+    EXPECT_EQ(deque_int.size(), copy.size());
+
+    deque_int.assign(v.rbegin(), v.rend());
+    EXPECT_EQ(1000, deque_int.size());
+    fori(i, 1000)
+        EXPECT_EQ(1000 - i - 1, deque_int[i]);
+}
 
+TEST_F(DequeTest, RangeInsert)
+{
+    const int values[] = { 100, 200, 300 };
+    fori(i, 10)
+        deque_int.push_front(i);
+
+    auto it = deque_int.insert(deque_int.begin() + 4, values, values + 3);
+    EXPECT_EQ(100, *it);
+    EXPECT_EQ(13, deque_int.size());
+    int expected[] = { 9, 8, 7, 6, 100, 200, 300, 5, 4, 3, 2, 1, 0 };
+    fori(i, 13)
+        EXPECT_EQ(expected[i], deque_int[i]);
+
+    deque_int.insert(deque_int.end(), values, values + 3);
+    deque_int.insert(deque_int.begin(), values, values + 1);
+    EXPECT_EQ(17, deque_int.size());
+    EXPECT_EQ(100, deque_int.front());
+    EXPECT_EQ(300, deque_int.back());
+
+    Deque<string> strings;
+    istringstream input("a b c");
+    strings.insert(strings.begin(), istream_iterator<string>(input), istream_iterator<string>());
+    EXPECT_EQ(3, strings.size());
+    EXPECT_EQ("a", strings.front());
+    EXPECT_EQ("c", strings.back());
+}
 
-        auto before_vector_push = clock.now();
-        fori(i, size)
-            vector_int.push_back(random(engine));
-        vector_int.clear();
-        auto vector_after_pop_back = clock.now();
+TEST_F(DequeTest, AppendBatchesMatchPushBack)
+{
+    vector<int> batch(1000);
+    fori(i, batch.size())
+        batch[i] = random(engine);
+
+    Deque<int> pushed;
+    fori(round, 20)
+    {
+        fori(i, batch.size())
+            pushed.push_back(batch[i]);
+        deque_int.append(batch.data(), batch.data() + batch.size());
+    }
+    EXPECT_EQ(20000, deque_int.size());
+    EXPECT_TRUE(equal(pushed.begin(), pushed.end(), deque_int.begin()));
+}
+
+TEST_F(DequeTest, IteratorArithmeticAcrossWrap)
+{
+    fori(i, 6)
+        deque_int.push_back(i);
+    fori(i, 3)
+        deque_int.push_front(-i - 1);
+
+    Deque<int>::iterator first = deque_int.begin();
+    Deque<int>::const_iterator last = deque_int.end();
+    EXPECT_EQ(9, last - Deque<int>::const_iterator(first));
+    EXPECT_EQ(-3, *first);
+    EXPECT_EQ(0, first[3]);
+    EXPECT_EQ(5, *(deque_int.end() - 1));
+    EXPECT_EQ(2, *(5 + first));
+
+    first += 8;
+    EXPECT_EQ(5, *first);
+    first -= 7;
+    EXPECT_EQ(-2, *first);
+    EXPECT_TRUE(first < deque_int.end());
+    EXPECT_TRUE(deque_int.begin() <= first);
+    EXPECT_EQ(deque_int.rbegin()[0], 5);
+    EXPECT_EQ(*deque_int.crbegin(), 5);
+
+    typedef iterator_traits<Deque<int>::const_iterator> traits;
+    EXPECT_TRUE((is_same<traits::iterator_category, random_access_iterator_tag>::value));
+    EXPECT_TRUE((is_same<traits::value_type, int>::value));
+    EXPECT_TRUE((is_same<traits::reference, const int&>::value));
+}
+
+TEST_F(DequeTest, SpansAfterWrap)
+{
+    fori(i, 5)
+        deque_int.push_back(i);
+    fori(i, 2)
+        deque_int.push_front(-i - 1);
+
+    auto spans = deque_int.as_spans();
+    EXPECT_EQ(7u, spans.first.size() + spans.second.size());
+    EXPECT_EQ(2u, spans.first.size());
+    EXPECT_EQ(-2, spans.first[0]);
+    EXPECT_EQ(0, spans.second[0]);
+
+    vector<int> seen;
+    deque_int.for_each_segment([&seen](int* first, int* last)
+    {
+        seen.insert(seen.end(), first, last);
+    });
+    EXPECT_TRUE(equal(deque_int.begin(), deque_int.end(), seen.begin()));
+    EXPECT_EQ(deque_int.size(), (int)seen.size());
+}
+
+TEST_F(DequeTest, SegmentAlgorithms)
+{
+    vector<int> v;
+    fori(i, 1000)
+    {
+        deque_int.push_front(i);
+        v.insert(v.begin(), i);
+    }
+    fori(i, 300)
+    {
+        deque_int.push_back(-i);
+        v.push_back(-i);
+    }
+
+    long long sum = 0;
+    for_each(deque_int.begin(), deque_int.end(), [&sum](int elem) { sum += elem; });
+    EXPECT_EQ(accumulate(v.begin(), v.end(), 0LL), sum);
+    EXPECT_EQ(sum, accumulate(deque_int.begin(), deque_int.end(), 0LL));
+    EXPECT_EQ(sum, accumulate(deque_int.cbegin(), deque_int.cend(), 0LL, plus<long long>()));
+
+    EXPECT_TRUE(equal(deque_int.begin(), deque_int.end(), v.begin()));
+    EXPECT_EQ(500, find(deque_int.begin(), deque_int.end(), 499) - deque_int.begin());
+    EXPECT_EQ(1100, find(deque_int.begin(), deque_int.end(), -100) - deque_int.begin());
+    EXPECT_TRUE(find(deque_int.begin(), deque_int.end(), 5000) == deque_int.end());
+    EXPECT_EQ(1200, find(deque_int.begin() + 3, deque_int.begin() + 1200, -250) - deque_int.begin());
+
+    vector<int> copied(deque_int.size());
+    copy(deque_int.begin(), deque_int.end(), copied.begin());
+    EXPECT_EQ(v, copied);
+
+    fill(deque_int.begin() + 10, deque_int.end() - 10, 7);
+    EXPECT_EQ(v[9], deque_int[9]);
+    EXPECT_EQ(7, deque_int[10]);
+    EXPECT_EQ(7, deque_int[deque_int.size() - 11]);
+    EXPECT_EQ(v[v.size() - 10], deque_int[deque_int.size() - 10]);
+}
+
+TEST_F(DequeTest, InstrumentedPolicyStats)
+{
+    Deque<int, allocator<int>, instrumented_policy<> > deque;
+    fori(i, 1000)
+        deque.push_back(i);
+    const deque_stats& stats = deque.stats();
+    // 8 -> 16 -> ... -> 1024, relocating the full ring every time.
+    EXPECT_EQ(7u, stats.grows);
+    EXPECT_EQ(0u, stats.shrinks);
+    EXPECT_EQ((8u + 16 + 32 + 64 + 128 + 256 + 512) * sizeof(int), stats.bytes_relocated);
+    EXPECT_EQ(1000u, stats.pushes_back);
+    EXPECT_EQ(1000u, stats.max_size);
+    EXPECT_EQ(1024u, stats.max_capacity);
+
+    int values[] = { 1, 2, 3 };
+    deque.prepend(values, values + 3);
+    deque.push_front(0);
+    EXPECT_EQ(4u, stats.pushes_front);
+    fori(i, 900)
+        deque.pop_front();
+    fori(i, 4)
+        deque.pop_back();
+    EXPECT_EQ(900u, stats.pops_front);
+    EXPECT_EQ(4u, stats.pops_back);
+    EXPECT_GT(stats.shrinks, 0u);
+    EXPECT_EQ(stats.grows + stats.shrinks, stats.reallocations);
+    EXPECT_EQ(1024u, stats.max_capacity);
+
+    deque.get_growth_policy().reset_stats();
+    EXPECT_EQ(0u, stats.reallocations);
+    EXPECT_EQ(0u, stats.pops_front);
+    EXPECT_THROW(deque[1000], exception*);
+    EXPECT_EQ(deque[0], deque.front());
+    EXPECT_EQ(3u, stats.bounds_checks);
+
+    stringstream dump;
+    stats.dump(dump);
+    EXPECT_NE(string::npos, dump.str().find("deque.bounds_checks=3\n"));
+    int counters = 0;
+    stats.for_each_counter([&](const char*, uint64_t) { counters++; });
+    EXPECT_EQ(12, counters);
+
+    Deque<int, allocator<int>, instrumented_policy<runtime_growth_policy> > fast_growing;
+    fast_growing.get_growth_policy().growth_shift = 2;
+    fori(i, 100)
+        fast_growing.push_back(i);
+    EXPECT_EQ(2u, fast_growing.stats().grows);
+    EXPECT_EQ(128u, fast_growing.stats().max_capacity);
+}
+
+template <typename T, typename MakeValue> void checkMiddleEdits(MakeValue make_value)
+{
+    default_random_engine engine(11);
+    Deque<T> tested;
+    deque<T> model;
+    fori(step, 20000)
+    {
+        uint op = engine() % 4;
+        int index = model.empty() ? 0 : (int)(engine() % (model.size() + 1));
+        if (op < 2 || model.empty())
+        {
+            T value = make_value(step);
+            auto it = tested.insert(tested.begin() + index, value);
+            model.insert(model.begin() + index, value);
+            ASSERT_EQ(index, it - tested.begin());
+        }
+        else if (op == 2)
+        {
+            index = min(index, (int)model.size() - 1);
+            auto it = tested.erase(tested.begin() + index);
+            model.erase(model.begin() + index);
+            ASSERT_EQ(index, it - tested.begin());
+        }
+        else
+        {
+            int last = index + (int)(engine() % 8);
+            last = min(last, (int)model.size());
+            tested.erase(tested.begin() + index, tested.begin() + last);
+            model.erase(model.begin() + index, model.begin() + last);
+        }
+        ASSERT_EQ((int)model.size(), tested.size());
+        if (step % 500 == 0)
+        {
+            ASSERT_TRUE(equal(model.begin(), model.end(), tested.begin()));
+        }
+    }
+    EXPECT_TRUE(equal(model.begin(), model.end(), tested.begin()));
+}
+
+TEST_F(DequeTest, InsertEraseMiddle)
+{
+    checkMiddleEdits<int>([](int step) { return step; });
+    checkMiddleEdits<string>([](int step) { return to_string(step) + string(step % 40, 'x'); });
+
+    // Shifts across the wrap point, both sides.
+    fori(i, 12)
+        deque_int.push_back(i);
+    fori(i, 6)
+        deque_int.pop_front();
+    fori(i, 6)
+        deque_int.push_back(12 + i);
+    deque_int.emplace(deque_int.begin() + 9, 100);
+    deque_int.emplace(deque_int.begin() + 2, 200);
+    int expected[] = { 6, 7, 200, 8, 9, 10, 11, 12, 13, 14, 100, 15, 16, 17 };
+    ASSERT_EQ(14, deque_int.size());
+    EXPECT_TRUE(equal(deque_int.begin(), deque_int.end(), expected));
+    deque_int.erase(deque_int.begin() + 1, deque_int.begin() + 12);
+    EXPECT_EQ(3, deque_int.size());
+    EXPECT_EQ(6, deque_int[0]);
+    EXPECT_EQ(16, deque_int[1]);
+}
+
+TEST_F(DequeTest, EraseIf)
+{
+    Deque<string> strings;
+    fori(i, 1000)
+        strings.push_front(to_string(i));
+    EXPECT_EQ(500u, strings.erase_if([](const string& value) { return (value.back() - '0') % 2 == 1; }));
+    EXPECT_EQ(500, strings.size());
+    EXPECT_EQ("998", strings.front());
+    EXPECT_EQ("0", strings.back());
+
+    fori(i, 1 << 16)
+        deque_int.push_back(i);
+    EXPECT_EQ((1u << 16) - 10, deque_int.erase_if([](int value) { return value >= 10; }));
+    EXPECT_EQ(10, deque_int.size());
+    EXPECT_EQ(9, deque_int.back());
+    EXPECT_EQ(0u, deque_int.erase_if([](int) { return false; }));
+}
+
+TEST_F(DequeTest, MremapGrowth)
+{
+    // 4 KiB threshold: rings of 1024 ints and more live in mmap'ed buffers.
+    Deque<int, mremap_allocator<int, 4096>, instrumented_policy<> > grown;
+    fori(i, 1 << 16)
+        grown.push_back(i);
+    EXPECT_EQ(14u, grown.stats().grows);
+    // Only the copying grows below the threshold move bytes: 8 + 16 + ... + 512 ints.
+    EXPECT_EQ(1016 * sizeof(int), grown.stats().bytes_relocated);
+    fori(i, 1 << 16)
+        EXPECT_EQ(i, grown[i]);
+
+    default_random_engine engine(5);
+    Deque<int, mremap_allocator<int, 4096> > mixed;
+    deque<int> model;
+    fori(i, 200000)
+    {
+        if (engine() % 3 == 0)
+        {
+            mixed.push_front(i);
+            model.push_front(i);
+        }
+        else
+        {
+            mixed.push_back(i);
+            model.push_back(i);
+        }
+        if (engine() % 5 == 0)
+        {
+            mixed.pop_front();
+            model.pop_front();
+        }
+    }
+    ASSERT_EQ((int)model.size(), mixed.size());
+    EXPECT_TRUE(equal(model.begin(), model.end(), mixed.begin()));
+    fori(i, (int)model.size() - 10)
+        mixed.pop_back();
+    EXPECT_EQ(10, mixed.size());
+    EXPECT_EQ(model.front(), mixed.front());
+
+    Deque<string, mremap_allocator<string, 4096> > strings;
+    fori(i, 5000)
+        strings.push_front(to_string(i));
+    EXPECT_EQ("4999", strings.front());
+    EXPECT_EQ("0", strings.back());
+}
+
+TEST_F(DequeTest, Linearize)
+{
+    EXPECT_TRUE(deque_int.is_contiguous());
+    fori(i, 6)
+        deque_int.push_back(i + 3);
+    fori(i, 3)
+        deque_int.push_front(2 - i);
+    EXPECT_FALSE(deque_int.is_contiguous());
+
+    int* data = deque_int.linearize();
+    EXPECT_TRUE(deque_int.is_contiguous());
+    fori(i, 9)
+        EXPECT_EQ(i, data[i]);
+    EXPECT_EQ(data, deque_int.as_spans().first.data());
+    EXPECT_EQ(data, deque_int.linearize());
+
+    deque_int.push_front(-1);
+    deque_int.push_back(9);
+    EXPECT_EQ(-1, deque_int.front());
+    EXPECT_EQ(9, deque_int.back());
+
+    Deque<string> deque_str;
+    fori(i, 100)
+        deque_str.push_back(to_string(i) + string(20, 'x'));
+    fori(i, 90)
+        deque_str.pop_front();
+    fori(i, 90)
+        deque_str.push_back(to_string(100 + i) + string(20, 'x'));
+    fori(i, 5)
+        deque_str.push_front(to_string(i) + string(20, 'y'));
+    EXPECT_FALSE(deque_str.is_contiguous());
+
+    string* strings = deque_str.linearize();
+    EXPECT_EQ(to_string(4) + string(20, 'y'), strings[0]);
+    EXPECT_EQ(to_string(90) + string(20, 'x'), strings[5]);
+    EXPECT_EQ(to_string(189) + string(20, 'x'), strings[deque_str.size() - 1]);
+
+    SmallDeque<int, 4> small;
+    fori(i, 3)
+        small.push_back(i + 1);
+    small.push_front(0);
+    int* small_data = small.linearize();
+    fori(i, 4)
+        EXPECT_EQ(i, small_data[i]);
+}
+
+TEST_F(DequeTest, LinearizeSortMatchesRingSort)
+{
+    const int maxn = 10 * 1000;
+    vector<int> values(maxn);
+    fori(i, maxn)
+        values[i] = random(engine);
+    deque_int.append(values.begin() + maxn / 2, values.end());
+    deque_int.prepend(values.begin(), values.begin() + maxn / 2);
+    Deque<int> wrapped(deque_int);
+    wrapped.push_front(0);
+    wrapped.pop_front();
+
+    std::sort(wrapped.begin(), wrapped.end());
+    int* data = deque_int.linearize();
+    sort(data, data + deque_int.size());
+    EXPECT_TRUE(equal(wrapped.begin(), wrapped.end(), deque_int.begin()));
+}
+
+TEST_F(DequeTest, ScanMatchesVector)
+{
+    const int maxn = 100 * 1000;
+    vector<int> vector_int;
+    fori(i, maxn)
+        vector_int.push_back(random(engine) & 0xff);
+    deque_int.append(vector_int.begin() + maxn / 2, vector_int.end());
+    deque_int.prepend(vector_int.begin(), vector_int.begin() + maxn / 2);
+
+    long long iterator_sum = 0;
+    for (auto it = deque_int.begin(); it != deque_int.end(); ++it)
+        iterator_sum += *it;
+    long long segment_sum = accumulate(deque_int.begin(), deque_int.end(), 0LL);
+    long long vector_sum = accumulate(vector_int.begin(), vector_int.end(), 0LL);
+    EXPECT_EQ(vector_sum, iterator_sum);
+    EXPECT_EQ(vector_sum, segment_sum);
+}
+
+class SegmentedDequeTest : public ::testing::Test
+{
+protected:
+    SegmentedDeque<int> deque_int;
+public:
+
+    uniform_int_distribution<int> random;
+    default_random_engine engine;
+};
+
+TEST_F(SegmentedDequeTest, Correct_PushBoth_1e5)
+{
+    const int maxn = 100 * 1000;
+    fori(i, maxn)
+    {
+        deque_int.push_back(i);
+        deque_int.push_front(-i - 1);
+    }
+    EXPECT_EQ(2 * maxn, deque_int.size());
+    fori(i, 2 * maxn)
+        EXPECT_EQ(i - maxn, deque_int[i]);
+}
+
+TEST_F(SegmentedDequeTest, Correct_Pop_1e5)
+{
+    const int maxn = 100 * 1000;
+    fori(i, maxn)
+        deque_int.push_back(i);
+    fori(i, maxn / 2)
+    {
+        EXPECT_EQ(i, deque_int.front());
+        deque_int.pop_front();
+        EXPECT_EQ(maxn - i - 1, deque_int.back());
+        deque_int.pop_back();
+    }
+    EXPECT_TRUE(deque_int.empty());
+
+    fori(i, maxn)
+    {
+        deque_int.push_front(i);
+        deque_int.pop_back();
+    }
+    EXPECT_EQ(0, deque_int.size());
+}
+
+TEST_F(SegmentedDequeTest, StableReferences)
+{
+    deque_int.push_back(1);
+    deque_int.push_front(2);
+    int* first = &deque_int[0];
+    int* second = &deque_int[1];
+
+    const int maxn = 100 * 1000;
+    fori(i, maxn)
+    {
+        deque_int.push_back(i);
+        deque_int.push_front(i);
+    }
+    EXPECT_EQ(first, &deque_int[maxn]);
+    EXPECT_EQ(second, &deque_int[maxn + 1]);
+    EXPECT_EQ(2, *first);
+    EXPECT_EQ(1, *second);
+}
+
+TEST_F(SegmentedDequeTest, SortAndReverse)
+{
+    vector<int> v;
+    const int maxn = 100 * 1000;
+    int elem;
+    fori(i, maxn)
+    {
+        elem = random(engine);
+        v.push_back(elem);
+        if (i % 2)
+            deque_int.push_back(elem);
+        else
+            deque_int.push_front(elem);
+    }
+
+    sort(v.begin(), v.end());
+    sort(deque_int.begin(), deque_int.end());
+    EXPECT_TRUE(equal(v.begin(), v.end(), deque_int.begin()));
+
+    reverse(deque_int.begin(), deque_int.end());
+    EXPECT_TRUE(equal(v.rbegin(), v.rend(), deque_int.cbegin()));
+    EXPECT_TRUE(equal(v.begin(), v.end(), deque_int.crbegin()));
+}
+
+TEST_F(SegmentedDequeTest, CopyAndClear)
+{
+    fori(i, 5000)
+        deque_int.push_front(i);
+    SegmentedDeque<int> copy(deque_int);
+    deque_int.clear();
+    EXPECT_EQ(0, deque_int.size());
+    EXPECT_EQ(5000, copy.size());
+    fori(i, 5000)
+        EXPECT_EQ(5000 - i - 1, copy[i]);
+
+    deque_int = copy;
+    EXPECT_TRUE(equal(copy.begin(), copy.end(), deque_int.begin()));
+}
+
+template <typename T> struct counting_allocator
+{
+    typedef T value_type;
+
+    int* live;
+    int* allocations;
+
+    counting_allocator(int* counter, int* total = nullptr)
+        : live(counter), allocations(total)
+    {
+    }
+
+    template <typename U> counting_allocator(const counting_allocator<U> & obj)
+        : live(obj.live), allocations(obj.allocations)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        (*live)++;
+        if (allocations != nullptr)
+            (*allocations)++;
+        return allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        (*live)--;
+        allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U> bool operator == (const counting_allocator<U> & obj) const
+    {
+        return live == obj.live;
+    }
+
+    template <typename U> bool operator != (const counting_allocator<U> & obj) const
+    {
+        return live != obj.live;
+    }
+};
+
+TEST(DequeAllocatorTest, UsesAllocatorTraits)
+{
+    int live = 0;
+    {
+        Deque<int, counting_allocator<int> > d((counting_allocator<int>(&live)));
+        EXPECT_EQ(1, live);
+        fori(i, 1000)
+            d.push_back(i);
+        fori(i, 1000)
+            d.pop_front();
+        EXPECT_EQ(1, live);
+
+        Deque<int, counting_allocator<int> > copy(d);
+        EXPECT_EQ(2, live);
+        Deque<int, counting_allocator<int> > moved(move(copy));
+        EXPECT_EQ(2, live);
+        d.clear();
+        EXPECT_EQ(2, live);
+    }
+    EXPECT_EQ(0, live);
+}
 
-        auto deque_duration = deque_after_pop_back - before_deque_push;
-        auto vector_duration = vector_after_pop_back - before_vector_push;
+TEST(DequeAllocatorTest, PoolReusesBuffers)
+{
+    buffer_pool pool;
+    pool_allocator<int> pool_alloc(pool);
+    {
+        Deque<int, pool_allocator<int> > d(pool_alloc);
+        fori(i, 1000)
+            d.push_back(i);
+        fori(i, 1000)
+            EXPECT_EQ(i, d[i]);
+    }
+    EXPECT_LT(0u, pool.cached());
+    size_t misses = pool.miss_count();
+
+    fori(round, 100)
+    {
+        Deque<int, pool_allocator<int> > d(pool_alloc);
+        fori(i, 1000)
+            d.push_front(i);
+        fori(i, 1000)
+            EXPECT_EQ(1000 - i - 1, d[i]);
+    }
+    EXPECT_EQ(misses, pool.miss_count());
+    EXPECT_LT(0u, pool.hit_count());
+
+    pool.release();
+    EXPECT_EQ(0u, pool.cached());
+}
+
+TEST(DequeAllocatorTest, PoolDequeCrossesThreads)
+{
+    Deque<int, pool_allocator<int> > d;
+    thread producer([&]()
+    {
+        fori(i, 1000)
+            d.push_back(i);
+    });
+    producer.join();
+
+    // The producer's pool is gone; growing, shrinking and freeing use the pools of the threads doing it.
+    thread consumer([&]()
+    {
+        fori(i, 1000)
+            d.push_back(1000 + i);
+        fori(i, 1900)
+            d.pop_front();
+        Deque<int, pool_allocator<int> > dropped(move(d));
+        EXPECT_EQ(100u, dropped.size());
+        EXPECT_EQ(1900, dropped.front());
+        EXPECT_EQ(1999, dropped.back());
+    });
+    consumer.join();
+    EXPECT_TRUE(d.empty());
+}
+
+struct tracked_value
+{
+    static int alive;
+    int value;
+
+    explicit tracked_value(int v)
+        : value(v)
+    {
+        alive++;
+    }
+
+    tracked_value(const tracked_value & obj)
+        : value(obj.value)
+    {
+        alive++;
+    }
+
+    tracked_value(tracked_value && obj)
+        : value(obj.value)
+    {
+        alive++;
+    }
+
+    tracked_value& operator = (const tracked_value &) = default;
+
+    ~tracked_value()
+    {
+        alive--;
+    }
+};
 
-        cerr << endl;
-        cerr << "Size = " << to_string(size) << endl;
-        cerr << "deque_duration / vector_duration = " << deque_duration.count() / (double)vector_duration.count() << endl;
-        cerr << "deque_time = " << deque_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << "vector_time = " << vector_duration.count() / (1000 * 1000.0) << " ms" << endl;
-        cerr << "relative_time = " << deque_duration.count() / (double)size / (1000 * 1000.0) << " ms" << endl;
-        cerr << endl;
+int tracked_value::alive = 0;
+
+TEST(DequeStorageTest, ConstructsOnlyLiveElements)
+{
+    {
+        Deque<tracked_value> d;
+        EXPECT_EQ(0, tracked_value::alive);
+        fori(i, 1000)
+            d.emplace_back(i);
+        fori(i, 1000)
+            d.emplace_front(-i);
+        EXPECT_EQ(2000, tracked_value::alive);
+
+        Deque<tracked_value> copy(d);
+        EXPECT_EQ(4000, tracked_value::alive);
+
+        fori(i, 1500)
+            d.pop_front();
+        EXPECT_EQ(2500, tracked_value::alive);
+        EXPECT_EQ(500, d.front().value);
+        EXPECT_EQ(999, d.back().value);
+
+        copy = d;
+        EXPECT_EQ(1000, tracked_value::alive);
+        d.clear();
+        EXPECT_EQ(500, tracked_value::alive);
+    }
+    EXPECT_EQ(0, tracked_value::alive);
+}
+
+TEST(DequeStorageTest, SegmentedConstructsOnlyLiveElements)
+{
+    int blocks = 0;
+    {
+        SegmentedDeque<tracked_value, counting_allocator<tracked_value> > d((counting_allocator<tracked_value>(&blocks)));
+        fori(i, 5000)
+            d.emplace_back(i);
+        fori(i, 5000)
+            d.push_front(tracked_value(-i));
+        EXPECT_EQ(10000, tracked_value::alive);
+        EXPECT_LT(0, blocks);
+
+        SegmentedDeque<tracked_value, counting_allocator<tracked_value> > copy(d);
+        EXPECT_EQ(20000, tracked_value::alive);
+
+        fori(i, 4000)
+        {
+            d.pop_front();
+            d.pop_back();
+        }
+        EXPECT_EQ(12000, tracked_value::alive);
+        EXPECT_EQ(-999, d[0].value);
+        EXPECT_EQ(999, d[1999].value);
+
+        SegmentedDeque<tracked_value, counting_allocator<tracked_value> > moved(move(copy));
+        copy = move(d);
+        EXPECT_EQ(12000, tracked_value::alive);
+        moved.clear();
+        EXPECT_EQ(2000, tracked_value::alive);
+    }
+    EXPECT_EQ(0, tracked_value::alive);
+    EXPECT_EQ(0, blocks);
+}
+
+TEST(DequeStorageTest, MoveOnlyElements)
+{
+    Deque<unique_ptr<int> > d;
+    fori(i, 100)
+    {
+        d.push_back(unique_ptr<int>(new int(i)));
+        d.emplace_front(new int(-i));
+    }
+    EXPECT_EQ(200, d.size());
+    fori(i, 100)
+    {
+        EXPECT_EQ(-99 + i, *d[i]);
+        EXPECT_EQ(i, *d[100 + i]);
+    }
+
+    Deque<unique_ptr<int> > moved(move(d));
+    EXPECT_EQ(200, moved.size());
+    fori(i, 150)
+        moved.pop_back();
+    EXPECT_EQ(-99, *moved[0]);
+}
+
+TEST(DequeStorageTest, ReuseMovedFrom)
+{
+    Deque<int> a;
+    a.push_back(1);
+    Deque<int> b(move(a));
+    EXPECT_TRUE(a.empty());
+    EXPECT_TRUE(a.begin() == a.end());
+    a.push_back(5);
+    a.push_front(4);
+    EXPECT_EQ(2, a.size());
+    EXPECT_EQ(4, a.front());
+    EXPECT_EQ(5, a.back());
+
+    b = move(a);
+    EXPECT_EQ(2, b.size());
+    a.clear();
+    a.emplace_front(7);
+    fori(i, 100)
+        a.push_back(i);
+    EXPECT_EQ(101, a.size());
+    EXPECT_EQ(7, a[0]);
+    EXPECT_EQ(99, a[100]);
+
+    Deque<string> strings;
+    strings.push_back("moved");
+    Deque<string> taken(move(strings));
+    strings.append(taken.begin(), taken.end());
+    strings.emplace_back("again");
+    EXPECT_EQ(2, strings.size());
+    EXPECT_EQ("again", strings.back());
+}
+
+TEST(DequeStorageTest, StringsSurviveRelocation)
+{
+    Deque<string> d;
+    vector<string> expected;
+    fori(i, 1000)
+    {
+        d.push_back(to_string(i));
+        expected.push_back(to_string(i));
+    }
+    fori(i, 900)
+        d.pop_front();
+    fori(i, 100)
+        EXPECT_EQ(expected[900 + i], d[i]);
+
+    fori(i, 900)
+        d.push_front(expected[900 - i - 1]);
+    fori(i, 1000)
+        EXPECT_EQ(expected[i], d[i]);
+}
+
+TEST(DequeGrowthPolicyTest, ClearKeepsCapacity)
+{
+    int live = 0, allocations = 0;
+    Deque<int, counting_allocator<int> > d((counting_allocator<int>(&live, &allocations)));
+    fori(i, 1000)
+        d.push_back(i);
+    int after_fill = allocations;
+
+    fori(tick, 100)
+    {
+        d.clear();
+        EXPECT_TRUE(d.empty());
+        fori(i, 1000)
+            d.push_back(i);
     }
-    cerr << endl;
+    EXPECT_EQ(after_fill, allocations);
+    EXPECT_EQ(999, d.back());
 }
 
+TEST(DequeGrowthPolicyTest, HysteresisAvoidsOscillation)
+{
+    int live = 0, allocations = 0;
+    Deque<int, counting_allocator<int> > d((counting_allocator<int>(&live, &allocations)));
+    fori(i, 256)
+        d.push_back(i);
+    fori(i, 192)
+        d.pop_back();
+    int after_shrink = allocations;
+
+    fori(round, 100)
+    {
+        d.push_back(round);
+        d.pop_back();
+        d.pop_back();
+        d.push_front(round);
+    }
+    EXPECT_EQ(after_shrink, allocations);
+    EXPECT_EQ(64, d.size());
+}
+
+TEST(DequeGrowthPolicyTest, ReserveAndShrinkToFit)
+{
+    int live = 0, allocations = 0;
+    Deque<int, counting_allocator<int> > d((counting_allocator<int>(&live, &allocations)));
+    d.reserve(10000);
+    int after_reserve = allocations;
+    fori(i, 10000)
+        d.push_back(i);
+    while (d.size() > 1)
+        d.pop_front();
+    EXPECT_EQ(after_reserve, allocations);
+    EXPECT_EQ(9999, d.front());
+
+    d.shrink_to_fit();
+    EXPECT_EQ(after_reserve + 1, allocations);
+    EXPECT_EQ(9999, d.front());
+    EXPECT_EQ(1, live);
+}
+
+TEST(DequeGrowthPolicyTest, CustomPolicies)
+{
+    int live = 0, allocations = 0;
+    typedef growth_policy<2, 0, 2, 64> no_shrink_policy;
+    Deque<int, counting_allocator<int>, no_shrink_policy> never_shrinks((counting_allocator<int>(&live, &allocations)));
+    fori(i, 1000)
+        never_shrinks.push_back(i);
+    EXPECT_EQ(3, allocations);
+    while (!never_shrinks.empty())
+        never_shrinks.pop_back();
+    EXPECT_EQ(3, allocations);
+
+    runtime_growth_policy runtime;
+    runtime.shrink_divisor = 0;
+    Deque<int, allocator<int>, runtime_growth_policy> tuned(allocator<int>(), runtime);
+    fori(i, 1000)
+        tuned.push_front(i);
+    tuned.get_growth_policy().shrink_divisor = 8;
+    while (tuned.size() > 10)
+        tuned.pop_back();
+    fori(i, 10)
+        EXPECT_EQ(1000 - i - 1, tuned[i]);
+}
+
+TEST(SmallDequeTest, StaysInlineUntilOverflow)
+{
+    int live = 0, allocations = 0;
+    typedef Deque<int, counting_allocator<int>, default_growth_policy, 15> small_deque;
+    {
+        small_deque d((counting_allocator<int>(&live, &allocations)));
+        fori(i, 15)
+            d.push_back(i);
+        d.clear();
+        fori(i, 15)
+            d.push_front(i);
+        EXPECT_EQ(0, allocations);
+        EXPECT_EQ(14, d.front());
+
+        d.push_front(15);
+        EXPECT_EQ(1, allocations);
+        EXPECT_EQ(1, live);
+        fori(i, 16)
+            EXPECT_EQ(15 - i, d[i]);
+
+        fori(i, 12)
+            d.pop_back();
+        EXPECT_EQ(0, live);
+        EXPECT_EQ(15, d.front());
+        EXPECT_EQ(12, d.back());
+    }
+    EXPECT_EQ(0, live);
+}
+
+TEST(SmallDequeTest, CopyAndMove)
+{
+    SmallDeque<string, 8> inline_deque;
+    fori(i, 5)
+        inline_deque.push_back(to_string(i));
+
+    SmallDeque<string, 8> copy(inline_deque);
+    SmallDeque<string, 8> moved(move(inline_deque));
+    EXPECT_EQ(5, copy.size());
+    EXPECT_EQ(5, moved.size());
+    EXPECT_TRUE(inline_deque.empty());
+    fori(i, 5)
+    {
+        EXPECT_EQ(to_string(i), copy[i]);
+        EXPECT_EQ(to_string(i), moved[i]);
+    }
+
+    fori(i, 100)
+        moved.push_front(to_string(-i));
+    SmallDeque<string, 8> heap_moved(move(moved));
+    EXPECT_EQ(105, heap_moved.size());
+    EXPECT_TRUE(moved.empty());
+    moved.push_back("reused");
+    EXPECT_EQ("reused", moved.front());
+
+    copy = heap_moved;
+    EXPECT_EQ(105, copy.size());
+    heap_moved = SmallDeque<string, 8>();
+    EXPECT_TRUE(heap_moved.empty());
+    sort(copy.begin(), copy.end());
+    EXPECT_EQ("-1", copy.front());
+}
+
+TEST(SpscDequeTest, SingleThread)
+{
+    SpscDeque<string> queue(5);
+    EXPECT_EQ(8u, queue.get_capacity());
+    fori(i, 8)
+        EXPECT_TRUE(queue.try_push(to_string(i)));
+    EXPECT_FALSE(queue.try_push("full"));
+
+    string value;
+    EXPECT_TRUE(queue.try_pop(value));
+    EXPECT_EQ("0", value);
+    EXPECT_TRUE(queue.try_emplace(3, 'x'));
+
+    vector<string> out;
+    EXPECT_EQ(8u, queue.try_pop_n(back_inserter(out), 100));
+    EXPECT_EQ("1", out[0]);
+    EXPECT_EQ("xxx", out[7]);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.try_pop(value));
+
+    const char* names[] = { "a", "b", "c" };
+    EXPECT_EQ(3u, queue.try_push_n(names, 3));
+    EXPECT_EQ(3u, queue.size_approx());
+}
+
+TEST(SpscDequeTest, ProducerConsumerOrder)
+{
+    const int maxn = 1000 * 1000;
+    SpscDeque<int> queue(1024);
+
+    thread producer([&queue, maxn]()
+    {
+        int batch[64];
+        for (int next = 0; next < maxn;)
+        {
+            int count = min(64, maxn - next);
+            fori(i, count)
+                batch[i] = next + i;
+            size_t pushed = queue.try_push_n(batch, count);
+            if (pushed == 0)
+                this_thread::yield();
+            next += (int)pushed;
+        }
+    });
+
+    long long sum = 0;
+    int expected = 0;
+    bool ordered = true;
+    while (expected < maxn)
+    {
+        int value;
+        if (expected % 2 == 0)
+        {
+            if (!queue.try_pop(value))
+            {
+                this_thread::yield();
+                continue;
+            }
+            ordered &= (value == expected++);
+            sum += value;
+        }
+        else
+        {
+            int batch[32];
+            size_t count = queue.try_pop_n(batch, 32);
+            if (count == 0)
+                this_thread::yield();
+            fori(i, count)
+            {
+                ordered &= (batch[i] == expected++);
+                sum += batch[i];
+            }
+        }
+    }
+    producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ((long long)maxn * (maxn - 1) / 2, sum);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(MpmcQueueTest, TryOperations)
+{
+    MpmcQueue<string> queue(3);
+    EXPECT_EQ(4u, queue.get_capacity());
+    fori(i, 4)
+        EXPECT_TRUE(queue.try_push(to_string(i)));
+    EXPECT_FALSE(queue.try_push("full"));
+    EXPECT_EQ(4u, queue.size_approx());
+
+    string value;
+    fori(i, 4)
+    {
+        EXPECT_TRUE(queue.try_pop(value));
+        EXPECT_EQ(to_string(i), value);
+    }
+    EXPECT_FALSE(queue.try_pop(value));
+    EXPECT_TRUE(queue.try_emplace(2, 'z'));
+    EXPECT_TRUE(queue.try_pop(value));
+    EXPECT_EQ("zz", value);
+}
+
+TEST(MpmcQueueTest, BlockingProducersConsumers)
+{
+    const int producers = 4, consumers = 3, per_producer = 50 * 1000;
+    MpmcQueue<int> queue(64);
+    atomic<long long> sum(0);
+    atomic<int> received(0);
+
+    vector<thread> threads;
+    fori(p, producers)
+        threads.push_back(thread([&queue, p, per_producer]()
+        {
+            fori(i, per_producer)
+                queue.push(p * per_producer + i + 1);
+        }));
+    fori(c, consumers)
+        threads.push_back(thread([&]()
+        {
+            for (;;)
+            {
+                int value;
+                queue.pop(value);
+                if (value == 0)
+                    return;
+                sum += value;
+                received++;
+            }
+        }));
+
+    fori(p, producers)
+        threads[p].join();
+    fori(c, consumers)
+        queue.push(0);
+    fori(c, consumers)
+        threads[producers + c].join();
+
+    long long total = (long long)producers * per_producer;
+    EXPECT_EQ(total, received.load());
+    EXPECT_EQ(total * (total + 1) / 2, sum.load());
+}
+
+TEST(WorkStealingDequeTest, OwnerAndThiefEnds)
+{
+    WorkStealingDeque<int> tasks(2);
+    fori(i, 100)
+        tasks.push(i);
+    EXPECT_EQ(100, tasks.size_approx());
+
+    int value;
+    EXPECT_TRUE(tasks.pop(value));
+    EXPECT_EQ(99, value);
+    EXPECT_TRUE(tasks.steal(value));
+    EXPECT_EQ(0, value);
+    EXPECT_TRUE(tasks.steal(value));
+    EXPECT_EQ(1, value);
+
+    while (tasks.pop(value))
+        ;
+    EXPECT_TRUE(tasks.empty());
+    EXPECT_FALSE(tasks.steal(value));
+}
+
+TEST(WorkStealingDequeTest, ConcurrentStealsTakeEachItemOnce)
+{
+    const int maxn = 200 * 1000, thieves = 3;
+    WorkStealingDeque<int> tasks(16);
+    vector<atomic<int> > taken(maxn);
+    fori(i, maxn)
+        taken[i].store(0);
+    atomic<bool> done(false);
+
+    vector<thread> threads;
+    fori(t, thieves)
+        threads.push_back(thread([&]()
+        {
+            int value;
+            while (!done.load())
+            {
+                if (tasks.steal(value))
+                    taken[value]++;
+                else
+                    this_thread::yield();
+            }
+            while (tasks.steal(value))
+                taken[value]++;
+        }));
+
+    int value;
+    fori(i, maxn)
+    {
+        tasks.push(i);
+        if (i % 3 == 0 && tasks.pop(value))
+            taken[value]++;
+    }
+    while (tasks.pop(value))
+        taken[value]++;
+    done.store(true);
+    for (auto& th : threads)
+        th.join();
+
+    int wrong = 0;
+    fori(i, maxn)
+        wrong += taken[i].load() != 1;
+    EXPECT_EQ(0, wrong);
+}
+
+long long parallelSum(ThreadPool& pool, const int* first, const int* last)
+{
+    if (last - first <= 16 * 1024)
+    {
+        long long sum = 0;
+        for (; first != last; ++first)
+            sum += *first;
+        return sum;
+    }
+    const int* middle = first + (last - first) / 2;
+    long long left = 0;
+    TaskGroup group(pool);
+    group.run([&pool, &left, first, middle]() { left = parallelSum(pool, first, middle); });
+    long long right = parallelSum(pool, middle, last);
+    group.wait();
+    return left + right;
+}
+
+TEST(ThreadPoolTest, ParallelRecursiveSum)
+{
+    const int maxn = 1 << 18;
+    vector<int> values(maxn);
+    fori(i, maxn)
+        values[i] = i % 1000;
+    long long expected = accumulate(values.begin(), values.end(), 0LL);
+
+    for (int threads_count = 1; threads_count <= 4; threads_count *= 2)
+    {
+        ThreadPool pool(threads_count);
+        EXPECT_EQ((uint)threads_count, pool.size());
+        long long sum = 0;
+        TaskGroup group(pool);
+        group.run([&]() { sum = parallelSum(pool, values.data(), values.data() + maxn); });
+        group.wait();
+        EXPECT_EQ(expected, sum);
+    }
+}
+
+TEST(BlockingDequeTest, CapacityAndClose)
+{
+    BlockingDeque<string> channel(2);
+    EXPECT_TRUE(channel.try_push("a"));
+    EXPECT_TRUE(channel.push("b"));
+    EXPECT_FALSE(channel.try_push("c"));
+    EXPECT_FALSE(channel.push_for("c", chrono::milliseconds(5)));
+    EXPECT_EQ(2u, channel.size());
+
+    string value;
+    EXPECT_TRUE(channel.pop(value));
+    EXPECT_EQ("a", value);
+
+    channel.close();
+    EXPECT_TRUE(channel.is_closed());
+    EXPECT_FALSE(channel.push("d"));
+    EXPECT_TRUE(channel.pop(value));
+    EXPECT_EQ("b", value);
+    EXPECT_FALSE(channel.pop(value));
+    EXPECT_FALSE(channel.pop_for(value, chrono::milliseconds(5)));
+    EXPECT_EQ(0u, channel.pop_n(&value, 1));
+}
+
+TEST(BlockingDequeTest, CloseWakesWaiters)
+{
+    BlockingDeque<int> channel(1);
+    int value;
+    thread consumer([&]() { EXPECT_FALSE(channel.pop(value)); });
+    this_thread::sleep_for(chrono::milliseconds(10));
+    channel.close();
+    consumer.join();
+}
+
+TEST(BlockingDequeTest, BatchedProducersConsumers)
+{
+    const int producers = 3, consumers = 2, per_producer = 50 * 1000, batch = 64;
+    BlockingDeque<int> channel(256);
+    atomic<long long> sum(0), received(0);
+
+    vector<thread> threads;
+    fori(p, producers)
+        threads.push_back(thread([&, p]()
+        {
+            vector<int> values(batch);
+            for (int i = 0; i < per_producer; i += batch)
+            {
+                int n = min(batch, per_producer - i);
+                fori(j, n)
+                    values[j] = p * per_producer + i + j + 1;
+                EXPECT_EQ((size_t)n, channel.push_n(values.begin(), n));
+            }
+        }));
+    fori(c, consumers)
+        threads.push_back(thread([&]()
+        {
+            vector<int> values(batch);
+            size_t n;
+            while ((n = channel.pop_n(values.begin(), batch)) != 0)
+            {
+                fori(j, n)
+                    sum += values[j];
+                received += n;
+            }
+        }));
+
+    fori(p, producers)
+        threads[p].join();
+    channel.close();
+    fori(c, consumers)
+        threads[producers + c].join();
+
+    long long total = (long long)producers * per_producer;
+    EXPECT_EQ(total, received.load());
+    EXPECT_EQ(total * (total + 1) / 2, sum.load());
+}
+
+TEST(BlockingDequeTest, BatchesAndRoundTrips)
+{
+    const int maxn = 1 << 14;
+    for (int batch = 1; batch <= 256; batch *= 16)
+    {
+        BlockingDeque<int> channel(1024);
+        long long sum = 0;
+        thread consumer([&]()
+        {
+            vector<int> values(batch);
+            size_t n;
+            while ((n = channel.pop_n(values.begin(), batch)) != 0)
+                fori(j, n)
+                    sum += values[j];
+        });
+        vector<int> values(batch);
+        for (int i = 0; i < maxn; i += batch)
+        {
+            fori(j, batch)
+                values[j] = i + j;
+            channel.push_n(values.begin(), batch);
+        }
+        channel.close();
+        consumer.join();
+        EXPECT_EQ((long long)maxn * (maxn - 1) / 2, sum);
+    }
+
+    BlockingDeque<int> ping(1), pong(1);
+    thread echo([&]()
+    {
+        int value;
+        while (ping.pop(value))
+            pong.push(value);
+    });
+    fori(i, 1000)
+    {
+        int value = -1;
+        ping.push(i);
+        pong.pop(value);
+        EXPECT_EQ(i, value);
+    }
+    ping.close();
+    echo.join();
+}
+
+TEST(ParallelAlgorithmTest, SortAcrossWrap)
+{
+    default_random_engine engine;
+    uniform_int_distribution<int> random;
+    ThreadPool pool(4);
+
+    for (int size : { 0, 1, 100, 5000, 100 * 1000, 300 * 1000 })
+    {
+        vector<int> values(size);
+        fori(i, size)
+            values[i] = random(engine) % 1000;
+        Deque<int> deque_int;
+        deque_int.append(values.begin() + size / 3, values.end());
+        deque_int.prepend(values.begin(), values.begin() + size / 3);
+
+        parallel_sort(pool, deque_int.begin(), deque_int.end(), greater<int>());
+        sort(values.begin(), values.end(), greater<int>());
+        EXPECT_TRUE(equal(values.begin(), values.end(), deque_int.begin()));
+    }
+
+    Deque<string> deque_str;
+    fori(i, 20000)
+        deque_str.push_front(to_string(i * 7919 % 20000));
+    parallel_sort(deque_str.begin(), deque_str.end());
+    EXPECT_TRUE(is_sorted(deque_str.begin(), deque_str.end()));
+    EXPECT_EQ("0", deque_str[0]);
+}
+
+TEST(ParallelAlgorithmTest, ForEachTransformReduce)
+{
+    const int maxn = 200 * 1000;
+    Deque<int> deque_int;
+    fori(i, maxn / 2)
+        deque_int.push_back(maxn / 2 + i);
+    fori(i, maxn / 2)
+        deque_int.push_front(maxn / 2 - 1 - i);
+
+    parallel_for_each(deque_int.begin(), deque_int.end(), [](int& value) { value *= 2; });
+    fori(i, maxn)
+        EXPECT_EQ(2 * i, deque_int[i]);
+
+    vector<long long> squares(maxn);
+    auto end = parallel_transform(deque_int.begin(), deque_int.end(), squares.begin(),
+                                  [](int value) { return (long long)value * value; });
+    EXPECT_TRUE(end == squares.end());
+    EXPECT_EQ(4LL * (maxn - 1) * (maxn - 1), squares.back());
+
+    long long sum = parallel_reduce(deque_int.begin(), deque_int.end(), 10LL);
+    EXPECT_EQ(10 + (long long)maxn * (maxn - 1), sum);
+    int largest = parallel_reduce(deque_int.begin(), deque_int.end(), 0, [](int a, int b) { return max(a, b); });
+    EXPECT_EQ(2 * (maxn - 1), largest);
+    // Associative but not commutative: partial results must be combined in chunk order.
+    int last = parallel_reduce(deque_int.begin(), deque_int.end(), -1, [](int, int b) { return b; });
+    EXPECT_EQ(deque_int.back(), last);
+
+    Deque<int> empty_deque;
+    EXPECT_EQ(5, parallel_reduce(empty_deque.begin(), empty_deque.end(), 5));
+}
+
+template <typename T> void checkSimdKernels(const Deque<T>& values, const vector<T>& expected)
+{
+    for (T probe : { expected[0], expected[expected.size() / 2], expected.back(), (T)-12345 })
+    {
+        auto found = find(expected.begin(), expected.end(), probe);
+        EXPECT_EQ(found == expected.end() ? -1 : (int)(found - expected.begin()), simd_find(values, probe));
+        EXPECT_EQ((size_t)count(expected.begin(), expected.end(), probe), simd_count(values, probe));
+        EXPECT_EQ((size_t)count_if(expected.begin(), expected.end(), [probe](T x) { return x > probe; }),
+                  simd_count_greater(values, probe));
+    }
+    EXPECT_EQ(*min_element(expected.begin(), expected.end()), simd_min(values));
+    EXPECT_EQ(*max_element(expected.begin(), expected.end()), simd_max(values));
+    EXPECT_EQ(accumulate(expected.begin(), expected.end(), (typename scalar_kernels<T>::sum_type)0), simd_sum(values));
+}
+
+TEST(DequeSimdTest, KernelsMatchScalar)
+{
+    default_random_engine engine;
+    uniform_int_distribution<int> random(-1000, 1000);
+    simd_isa detected = detected_simd_isa();
+
+    for (int size : { 1, 3, 8, 17, 1000, 4099 })
+    {
+        vector<int> ints(size);
+        vector<float> floats(size);
+        vector<short> shorts(size);
+        fori(i, size)
+        {
+            ints[i] = random(engine);
+            floats[i] = (float)random(engine);
+            shorts[i] = (short)random(engine);
+        }
+        Deque<int> deque_int;
+        Deque<float> deque_float;
+        Deque<short> deque_short;
+        deque_int.append(ints.begin() + size / 2, ints.end());
+        deque_int.prepend(ints.begin(), ints.begin() + size / 2);
+        deque_float.append(floats.begin() + size / 2, floats.end());
+        deque_float.prepend(floats.begin(), floats.begin() + size / 2);
+        deque_short.append(shorts.begin(), shorts.end());
+
+        for (int isa = simd_scalar; isa <= detected; isa++)
+        {
+            active_simd_isa() = (simd_isa)isa;
+            checkSimdKernels(deque_int, ints);
+            checkSimdKernels(deque_float, floats);
+            checkSimdKernels(deque_short, shorts);
+        }
+        active_simd_isa() = detected;
+    }
+
+    Deque<int> empty_deque;
+    EXPECT_EQ(-1, simd_find(empty_deque, 1));
+    EXPECT_EQ(0, simd_sum(empty_deque));
+    EXPECT_THROW(simd_min(empty_deque), exception*);
+}
+
+TEST(CircularBufferTest, OverwritesOldest)
+{
+    CircularBuffer<int> window(5);
+    EXPECT_EQ(5u, window.max_size());
+    EXPECT_TRUE(window.empty());
+
+    fori(i, 12)
+        window.push_back(i);
+    EXPECT_TRUE(window.full());
+    EXPECT_EQ(5u, window.size());
+    fori(i, 5)
+        EXPECT_EQ(7 + i, window[i]);
+    EXPECT_EQ(7, window.front());
+    EXPECT_EQ(11, window.back());
+
+    window.push_front(100);
+    EXPECT_EQ(100, window.front());
+    EXPECT_EQ(10, window.back());
+
+    window.pop_back();
+    window.pop_front();
+    EXPECT_EQ(3u, window.size());
+    EXPECT_EQ(7, window.front());
+    EXPECT_THROW(window[3], exception*);
+}
+
+TEST(CircularBufferTest, IteratorsAndAlgorithms)
+{
+    CircularBuffer<int> window(1000);
+    fori(i, 2500)
+        window.push_back((i * 7919) % 2500);
+
+    int* storage = window.as_spans().second.data();
+    EXPECT_FALSE(window.as_spans().second.empty());
+    sort(window.begin(), window.end());
+    EXPECT_TRUE(is_sorted(window.begin(), window.end()));
+    EXPECT_EQ(1000, window.end() - window.begin());
+
+    long long sum = 0;
+    for_each(window.begin(), window.end(), [&sum](int x) { sum += x; });
+    EXPECT_EQ(accumulate(window.begin(), window.end(), 0LL), sum);
+
+    vector<int> reversed(window.rbegin(), window.rend());
+    EXPECT_TRUE(is_sorted(reversed.rbegin(), reversed.rend()));
+
+    fori(i, 5000)
+        window.push_back(i);
+    EXPECT_EQ(4000, window.front());
+    pair<ring_span<int>, ring_span<int> > spans = window.as_spans();
+    EXPECT_TRUE(spans.first.data() >= storage && spans.first.data() < storage + 1024);
+    EXPECT_EQ(1000u, spans.first.size() + spans.second.size());
+}
+
+TEST(CircularBufferTest, NonTrivialElements)
+{
+    CircularBuffer<string> history(3);
+    fori(i, 10)
+        history.push_back(to_string(i) + string(30, '.'));
+    EXPECT_EQ(to_string(7) + string(30, '.'), history.front());
+
+    CircularBuffer<string> copy(history);
+    history.push_back("x");
+    EXPECT_EQ(to_string(7) + string(30, '.'), copy.front());
+    EXPECT_EQ(to_string(8) + string(30, '.'), history.front());
+
+    CircularBuffer<string> moved(move(copy));
+    EXPECT_EQ(3u, moved.size());
+    copy = moved;
+    EXPECT_EQ(moved.back(), copy.back());
+    history.clear();
+    EXPECT_TRUE(history.empty());
+}
+
+TEST(CircularBufferTest, ReuseMovedFrom)
+{
+    CircularBuffer<int> window(5);
+    fori(i, 7)
+        window.push_back(i);
+    CircularBuffer<int> moved(move(window));
+    EXPECT_EQ(5u, moved.size());
+    EXPECT_TRUE(window.empty());
+    EXPECT_EQ(5u, window.max_size());
+    EXPECT_TRUE(window.begin() == window.end());
+
+    fori(i, 7)
+        window.push_back(10 + i);
+    window.push_front(0);
+    EXPECT_EQ(5u, window.size());
+    EXPECT_EQ(0, window.front());
+    EXPECT_EQ(15, window.back());
+
+    CircularBuffer<string> strings(2);
+    strings.push_back("a");
+    CircularBuffer<string> taken(move(strings));
+    strings.emplace_front("b");
+    strings.emplace_back("c");
+    strings.emplace_back("d");
+    EXPECT_EQ("c", strings.front());
+    EXPECT_EQ("d", strings.back());
+    EXPECT_EQ("a", taken.front());
+}
+
+TEST(CircularBufferTest, LastNMatchesDeque)
+{
+    const int maxn = 10 * 1000;
+    const uint window_size = 1000;
+
+    Deque<int> deque_window;
+    CircularBuffer<int> ring_window(window_size);
+    fori(i, maxn)
+    {
+        if ((uint)deque_window.size() == window_size)
+            deque_window.pop_front();
+        deque_window.push_back(i);
+        ring_window.push_back(i);
+    }
+    EXPECT_EQ(window_size, ring_window.size());
+    EXPECT_TRUE(equal(ring_window.begin(), ring_window.end(), deque_window.begin()));
+}
+
+TEST(SlidingWindowTest, CountBasedMatchesRescan)
+{
+    default_random_engine engine;
+    uniform_int_distribution<int> random(-1000, 1000);
+    const int maxn = 5000, window = 37;
+
+    MinWindow<int> min_window;
+    MaxWindow<int> max_window;
+    SumWindow<long long> sum_window;
+    auto max_op = [](int a, int b) { return max(a, b); };
+    TwoStackWindow<int, decltype(max_op)> two_stack(numeric_limits<int>::min(), max_op);
+
+    Deque<int> values;
+    fori(i, maxn)
+    {
+        int value = random(engine);
+        values.push_back(value);
+        if (values.size() > window)
+            values.pop_front();
+
+        min_window.push(i, value);
+        max_window.push(i, value);
+        sum_window.push(i, value);
+        two_stack.push(i, value);
+        min_window.evict_until(i - window + 1);
+        max_window.evict_until(i - window + 1);
+        sum_window.evict_until(i - window + 1);
+        two_stack.evict_until(i - window + 1);
+
+        EXPECT_EQ(*min_element(values.begin(), values.end()), min_window.query());
+        EXPECT_EQ(*max_element(values.begin(), values.end()), max_window.query());
+        EXPECT_EQ(accumulate(values.begin(), values.end(), 0LL), sum_window.query());
+        EXPECT_EQ(*max_element(values.begin(), values.end()), two_stack.query());
+        EXPECT_EQ(values.size(), two_stack.size());
+    }
+}
+
+TEST(SlidingWindowTest, TwoStackKeepsOrder)
+{
+    auto concat = [](const string& a, const string& b) { return a + b; };
+    TwoStackWindow<string, decltype(concat)> window(string(), concat);
+    EXPECT_EQ("", window.query());
+
+    fori(i, 10)
+    {
+        window.push(i, string(1, 'a' + i));
+        window.evict_until(i - 3);
+    }
+    EXPECT_EQ("ghij", window.query());
+    window.evict_until(8);
+    window.push(10, "k");
+    EXPECT_EQ("ijk", window.query());
+    window.evict_until(100);
+    EXPECT_TRUE(window.empty());
+    EXPECT_EQ("", window.query());
+}
+
+TEST(SlidingWindowTest, TimeBasedEviction)
+{
+    typedef chrono::steady_clock::time_point time_point;
+    chrono::steady_clock::time_point start;
+    MaxWindow<double, time_point> peak;
+    SumWindow<double, time_point> total;
+
+    double samples[] = { 1.5, 7.0, 2.0, 3.0, 0.5 };
+    fori(i, 5)
+    {
+        time_point now = start + chrono::milliseconds(100 * i);
+        peak.push(now, samples[i]);
+        total.push(now, samples[i]);
+        peak.evict_until(now - chrono::milliseconds(250));
+        total.evict_until(now - chrono::milliseconds(250));
+    }
+    EXPECT_EQ(3.0, peak.query());
+    EXPECT_DOUBLE_EQ(5.5, total.query());
+    EXPECT_EQ(3, total.size());
+
+    peak.evict_until(start + chrono::milliseconds(1000));
+    EXPECT_TRUE(peak.empty());
+    EXPECT_THROW(peak.query(), exception*);
+}
+
+TEST(SlidingWindowTest, MatchesNaiveScan)
+{
+    default_random_engine engine;
+    uniform_int_distribution<int> random;
+    const int maxn = 5000, window = 100;
+
+    Deque<int> values;
+    MinWindow<int> min_window;
+    SumWindow<long long> sum_window;
+    fori(i, maxn)
+    {
+        int value = random(engine);
+        values.push_back(value);
+        if (values.size() > window)
+            values.pop_front();
+        min_window.push(i, value);
+        sum_window.push(i, value);
+        min_window.evict_until(i - window + 1);
+        sum_window.evict_until(i - window + 1);
+        ASSERT_EQ(*min_element(values.begin(), values.end()), min_window.query());
+        ASSERT_EQ(accumulate(values.begin(), values.end(), 0LL), sum_window.query());
+    }
+}
+
+TEST(DequeIoTest, StreamRoundTripAcrossWrap)
+{
+    Deque<int> deque;
+    fori(i, 1000)
+        deque.push_back(i);
+    fori(i, 300)
+        deque.pop_front();
+    fori(i, 300)
+        deque.push_back(1000 + i);
+    ASSERT_FALSE(deque.is_contiguous());
+
+    stringstream stream;
+    save(deque, stream);
+    EXPECT_EQ(serialized_size(deque), stream.str().size());
+
+    Deque<int> loaded;
+    loaded.push_back(-1);
+    load(loaded, stream);
+    ASSERT_EQ(deque.size(), loaded.size());
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), loaded.begin()));
+}
+
+TEST(DequeIoTest, CodecForStrings)
+{
+    Deque<string> deque;
+    fori(i, 200)
+        deque.push_front(string(i % 17, 'a' + i % 26));
+
+    vector<char> bytes(serialized_size(deque));
+    EXPECT_EQ(bytes.size(), serialize_to(deque, ring_span<char>(bytes.data(), (uint)bytes.size())));
+
+    Deque<string> loaded;
+    EXPECT_EQ(bytes.size(), deserialize_from(loaded, ring_span<const char>(bytes.data(), (uint)bytes.size())));
+    ASSERT_EQ(deque.size(), loaded.size());
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), loaded.begin()));
+}
+
+TEST(DequeIoTest, BuffersAndStreamingReader)
+{
+    Deque<long long> deque;
+    fori(i, 5000)
+        deque.push_front((long long)i * i);
+
+    size_t size = serialized_size(deque);
+    vector<char> bytes(size), shifted(size + 1);
+    EXPECT_EQ(size, serialize_to(deque, ring_span<char>(bytes.data(), (uint)size)));
+    // The same bytes at an odd address go through the staged path.
+    memcpy(shifted.data() + 1, bytes.data(), size);
+
+    Deque<long long> aligned, unaligned;
+    EXPECT_EQ(size, deserialize_from(aligned, ring_span<const char>(bytes.data(), (uint)size)));
+    EXPECT_EQ(size, deserialize_from(unaligned, ring_span<const char>(shifted.data() + 1, (uint)size)));
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), aligned.begin()));
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), unaligned.begin()));
+
+    stringstream stream;
+    save(deque, stream);
+    DequeReader<long long> reader(stream, 1000 * sizeof(long long));
+    Deque<long long> streamed;
+    EXPECT_EQ(5000u, reader.size());
+    EXPECT_EQ(1500u, reader.read_into(streamed, 1500));
+    EXPECT_EQ(3500u, reader.remaining());
+    EXPECT_EQ(1500, streamed.size());
+    EXPECT_EQ(3500u, reader.read_into(streamed));
+    EXPECT_EQ(0u, reader.read_into(streamed));
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), streamed.begin()));
+
+    EXPECT_THROW(deserialize_from(aligned, ring_span<const char>(bytes.data(), (uint)size - 1)), runtime_error*);
+    EXPECT_THROW(deserialize_from(unaligned, ring_span<const char>(shifted.data() + 1, (uint)size - 1)), runtime_error*);
+    Deque<int> other;
+    EXPECT_THROW(deserialize_from(other, ring_span<const char>(bytes.data(), (uint)size)), runtime_error*);
+    bytes[0] = 'X';
+    EXPECT_THROW(deserialize_from(aligned, ring_span<const char>(bytes.data(), (uint)size)), runtime_error*);
+}
+
+TEST(DequeIoTest, SaveLoadRoundTrip)
+{
+    const int maxn = 10 * 1000;
+    Deque<int> deque;
+    fori(i, maxn)
+        deque.push_front(i);
+
+    stringstream stream;
+    save(deque, stream);
+    Deque<int> loaded;
+    load(loaded, stream);
+    ASSERT_EQ(maxn, loaded.size());
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), loaded.begin()));
+
+    // Loading leaves no reserved floor behind: draining the deque shrinks it.
+    Deque<int, allocator<int>, instrumented_policy<> > instrumented;
+    stream.clear();
+    stream.seekg(0);
+    load(instrumented, stream);
+    EXPECT_EQ(maxn, instrumented.size());
+    fori(i, maxn - 10)
+        instrumented.pop_back();
+    EXPECT_LT(0u, instrumented.stats().shrinks);
+}
+
+TEST(PersistentDequeTest, SnapshotsMatchModel)
+{
+    default_random_engine engine(7);
+    PersistentDeque<int> current;
+    deque<int> model;
+    vector<pair<PersistentDeque<int>, deque<int> > > versions;
+    int next = 0;
+
+    fori(step, 200000)
+    {
+        uint op = engine() % 10;
+        // Bursts in one direction so the tree grows, drains and rebalances.
+        if (step % 50000 > 40000)
+            op = op < 5 ? 2 : 3;
+        if (op < 3)
+        {
+            current.push_back(next);
+            model.push_back(next++);
+        }
+        else if (op < 5)
+        {
+            current.push_front(next);
+            model.push_front(next++);
+        }
+        else if (!model.empty() && op < 7)
+        {
+            current.pop_back();
+            model.pop_back();
+        }
+        else if (!model.empty() && op < 9)
+        {
+            current.pop_front();
+            model.pop_front();
+        }
+        if (step % 997 == 0)
+            versions.push_back(make_pair(current.snapshot(), model));
+    }
+    ASSERT_EQ(model.size(), current.size());
+    EXPECT_TRUE(equal(model.begin(), model.end(), current.begin()));
+
+    for (auto& version : versions)
+    {
+        ASSERT_EQ(version.second.size(), version.first.size());
+        EXPECT_TRUE(equal(version.second.begin(), version.second.end(), version.first.begin()));
+        if (!version.second.empty())
+        {
+            int index = (int)(engine() % version.second.size());
+            EXPECT_EQ(version.second[index], version.first[index]);
+            EXPECT_EQ(version.second.front(), version.first.front());
+            EXPECT_EQ(version.second.back(), version.first.back());
+        }
+    }
+}
+
+TEST(PersistentDequeTest, AlternatingEndsAndErrors)
+{
+    PersistentDeque<string> small;
+    EXPECT_THROW(small.pop_back(), exception*);
+    EXPECT_THROW(small.front(), exception*);
+    fori(i, 5)
+        small.push_back(to_string(i));
+    PersistentDeque<string> before = small;
+    small.pop_front();
+    small.pop_back();
+    small.pop_front();
+    EXPECT_EQ(2u, small.size());
+    EXPECT_EQ("2", small[0]);
+    EXPECT_EQ("3", small.back());
+    small.push_front("x");
+    EXPECT_EQ("x", small.front());
+    EXPECT_EQ(5u, before.size());
+    EXPECT_EQ("0", before.front());
+    EXPECT_EQ("4", before.back());
+    EXPECT_THROW(before[5], exception*);
+}
+
+TEST(PersistentDequeTest, ConversionAndSharing)
+{
+    Deque<int> deque;
+    fori(i, 100000)
+        deque.push_front(i);
+    PersistentDeque<int> persistent(deque);
+    ASSERT_EQ(deque.size(), (int)persistent.size());
+    EXPECT_TRUE(equal(deque.begin(), deque.end(), persistent.begin()));
+    fori(i, 1000)
+        EXPECT_EQ(deque[i * 97], persistent[i * 97]);
+
+    PersistentDeque<int> reader = persistent.snapshot();
+    EXPECT_EQ(&persistent[50000], &reader[50000]);
+    persistent.push_back(-1);
+    persistent.pop_front();
+    EXPECT_EQ(&persistent[49999], &reader[50000]);
+    EXPECT_EQ(99999, reader.front());
+    EXPECT_EQ(0, reader.back());
+
+    Deque<int> back_again = persistent.to_deque();
+    EXPECT_EQ(100000, back_again.size());
+    EXPECT_EQ(99998, back_again.front());
+    EXPECT_EQ(-1, back_again.back());
+    EXPECT_TRUE(equal(back_again.begin(), back_again.end(), persistent.begin()));
+    EXPECT_TRUE((is_same<iterator_traits<PersistentDeque<int>::const_iterator>::value_type, int>::value));
+}
+
+void checkMirroredDeque(mirror_mode mode)
+{
+    MirroredDeque<int> deque(1, mode);
+    uint capacity = deque.get_capacity();
+    EXPECT_EQ(0u, capacity * sizeof(int) % 4096);
+
+    // Wrap the ring: the elements start near the end of the buffer.
+    fori(i, capacity)
+        deque.push_back(i);
+    fori(i, capacity - 10)
+        deque.pop_front();
+    fori(i, 100)
+        deque.push_back((int)capacity + i);
+    ASSERT_EQ(110u, deque.size());
+    EXPECT_EQ(capacity, deque.get_capacity());
+
+    pair<ring_span<int>, ring_span<int> > spans = deque.as_spans();
+    EXPECT_EQ(mode == mirror_mode::automatic && deque.is_mirrored(), spans.second.empty());
+    const int* first_element = &deque[0];
+    ring_span<int> window = deque.window(5, 20);
+    fori(i, 20)
+        EXPECT_EQ((int)capacity - 5 + i, window[i]);
+    int* data = deque.data();
+    EXPECT_EQ(deque.is_mirrored(), data == first_element);
+    fori(i, 110)
+        EXPECT_EQ((int)capacity - 10 + i, data[i]);
+
+    fori(i, 3 * capacity)
+        deque.push_front(-i - 1);
+    EXPECT_EQ(110 + 3 * capacity, deque.size());
+    EXPECT_EQ(-3 * (int)capacity, deque.front());
+    EXPECT_EQ((int)capacity + 99, deque.back());
+    EXPECT_TRUE(is_sorted(deque.begin(), deque.end()));
+    EXPECT_THROW(deque.window(100, 3 * capacity + 11), exception*);
+
+    MirroredDeque<int> moved(move(deque));
+    EXPECT_EQ(110 + 3 * capacity, moved.size());
+    EXPECT_TRUE(deque.empty());
+    EXPECT_EQ(0u, deque.get_capacity());
+    deque.push_back(1);
+    deque.push_front(0);
+    EXPECT_EQ(2u, deque.size());
+    EXPECT_EQ(0, deque.data()[0]);
+    EXPECT_EQ(1, deque.data()[1]);
+}
+
+TEST(MirroredDequeTest, ContiguousAcrossWrap)
+{
+    checkMirroredDeque(mirror_mode::automatic);
+    checkMirroredDeque(mirror_mode::plain);
+
+    MirroredDeque<char> plain(1, mirror_mode::plain);
+    EXPECT_FALSE(plain.is_mirrored());
+#if defined(__linux__)
+    MirroredDeque<char> mirrored(1);
+    EXPECT_TRUE(mirrored.is_mirrored());
+#endif
+}
+
+#if !defined(_WIN32)
+
+string mappedDequePath(const string& name)
+{
+    return "mapped_deque_" + name + "_" + to_string(getpid()) + ".bin";
+}
+
+TEST(MappedDequeTest, ReopenKeepsContents)
+{
+    string path = mappedDequePath("reopen");
+    {
+        MappedDeque<int> queue(path, 4);
+        fori(i, 1000)
+            queue.push_back(i);
+        fori(i, 10)
+            queue.push_front(-1 - i);
+        fori(i, 5)
+            queue.pop_front();
+        queue.flush();
+        EXPECT_GE(queue.get_capacity(), 1005u);
+    }
+    {
+        MappedDeque<int> queue(path);
+        EXPECT_EQ(1005u, queue.size());
+        EXPECT_EQ(-5, queue.front());
+        EXPECT_EQ(999, queue.back());
+        vector<int> expected;
+        fori(i, 5)
+            expected.push_back(-5 + i);
+        fori(i, 1000)
+            expected.push_back(i);
+        EXPECT_TRUE(equal(expected.begin(), expected.end(), queue.begin()));
+        queue.clear();
+    }
+    {
+        MappedDeque<int> queue(path);
+        EXPECT_TRUE(queue.empty());
+        EXPECT_THROW(MappedDeque<long long> wrong_type(path), exception*);
+    }
+    unlink(path.c_str());
+}
+
+TEST(MappedDequeTest, RejectsOtherVersions)
+{
+    string path = mappedDequePath("version");
+    {
+        MappedDeque<int> queue(path);
+        queue.push_back(1);
+    }
+    {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        uint32_t version = mapped_deque_version + 1;
+        file.seekp(offsetof(mapped_deque_header, version));
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    }
+    EXPECT_THROW(MappedDeque<int> queue(path), exception*);
+    unlink(path.c_str());
+}
+
+struct mapped_record
+{
+    uint64_t seq;
+    uint64_t check;
+    char payload[48];
+};
+
+// Polls the header of a MappedDeque file until it holds at least one element.
+bool waitForMappedRecords(const string& path, chrono::milliseconds timeout)
+{
+    auto deadline = chrono::steady_clock::now() + timeout;
+    while (chrono::steady_clock::now() < deadline)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            mapped_deque_header header;
+            bool ready = pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                         memcmp(header.magic, mapped_deque_magic, sizeof(header.magic)) == 0 &&
+                         header.tail != header.head;
+            close(fd);
+            if (ready)
+                return true;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return false;
+}
+
+TEST(MappedDequeTest, SurvivesKillDuringWrites)
+{
+    string path = mappedDequePath("crash");
+    unlink(path.c_str());
+
+    fori(round, 3)
+    {
+        SCOPED_TRACE("round " + to_string(round));
+        pid_t child = fork();
+        ASSERT_GE(child, 0);
+        if (child == 0)
+        {
+            try
+            {
+                MappedDeque<mapped_record> queue(path, 8);
+                uint64_t seq = queue.empty() ? 0 : queue.back().seq + 1;
+                for (;; seq++)
+                {
+                    mapped_record record;
+                    record.seq = seq;
+                    record.check = seq * 0x9E3779B97F4A7C15ull;
+                    memset(record.payload, (int)(seq & 0x7f), sizeof(record.payload));
+                    queue.push_back(record);
+                    if (seq % 3 == 0)
+                        queue.pop_front();
+                }
+            }
+            catch (...)
+            {
+            }
+            _exit(1);
+        }
+        bool wrote = waitForMappedRecords(path, chrono::seconds(10));
+        this_thread::sleep_for(chrono::milliseconds(20 + 30 * round));
+        kill(child, SIGKILL);
+        int status;
+        waitpid(child, &status, 0);
+        ASSERT_TRUE(wrote) << "the writer stored nothing before the timeout";
+
+        MappedDeque<mapped_record> queue(path);
+        ASSERT_FALSE(queue.empty());
+        uint64_t first = queue.front().seq;
+        int broken = 0;
+        fori(i, queue.size())
+        {
+            const mapped_record& record = queue[i];
+            broken += record.seq != first + i || record.check != record.seq * 0x9E3779B97F4A7C15ull ||
+                      record.payload[sizeof(record.payload) - 1] != (char)(record.seq & 0x7f);
+        }
+        EXPECT_EQ(0, broken) << "recovered " << queue.size() << " records, capacity " << queue.get_capacity();
+    }
+    unlink(path.c_str());
+}
+
+#endif
+
 int main(int argc, char **argv)
 {
     cerr.setf(cerr.fixed);
@@ -437,8 +2454,10 @@ int main(int argc, char **argv)
 
     testing::InitGoogleTest(&argc, argv);
 
-    RUN_ALL_TESTS();
+    int result = RUN_ALL_TESTS();
 
+#ifdef _MSC_VER
     system("pause");
-    return 0;
+#endif
+    return result;
 }
\ No newline at end of file
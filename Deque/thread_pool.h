@@ -0,0 +1,239 @@
+#pragma once
+#include "base.h"
+#include "deque.h"
+#include "work_stealing_deque.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed-size pool of workers, each owning a WorkStealingDeque of tasks. Tasks
+ * submitted from a worker go to its own deque (LIFO for the owner), tasks
+ * submitted from other threads go to a shared injection Deque. Idle workers
+ * steal from random victims and park when there is nothing to do.
+ */
+class ThreadPool
+{
+    typedef function<void()> task;
+
+    struct worker_slot
+    {
+        WorkStealingDeque<task*> tasks;
+    };
+
+    struct worker_context
+    {
+        ThreadPool* pool;
+        uint index;
+    };
+
+    vector<unique_ptr<worker_slot> > slots;
+    vector<thread> workers;
+
+    mutex inject_lock;
+    Deque<task*> injected;
+    atomic<int> injected_count;
+
+    mutex park_lock;
+    condition_variable park_cond;
+    atomic<int> sleeping;
+    atomic<size_t> epoch;
+    atomic<bool> stopping;
+
+    static worker_context& context()
+    {
+        static thread_local worker_context current = { nullptr, 0 };
+        return current;
+    }
+
+    void wakeOne()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sleeping.load(memory_order_relaxed) != 0)
+        {
+            lock_guard<mutex> guard(park_lock);
+            epoch.fetch_add(1, memory_order_release);
+            park_cond.notify_one();
+        }
+    }
+
+    task* takeInjected()
+    {
+        if (injected_count.load(memory_order_acquire) == 0)
+            return nullptr;
+        lock_guard<mutex> guard(inject_lock);
+        if (injected.empty())
+            return nullptr;
+        task* t = injected.front();
+        injected.pop_front();
+        injected_count.fetch_sub(1, memory_order_release);
+        return t;
+    }
+
+    task* findTask(uint self, minstd_rand& rng)
+    {
+        task* t = nullptr;
+        if (self < slots.size() && slots[self]->tasks.pop(t))
+            return t;
+        if ((t = takeInjected()) != nullptr)
+            return t;
+        uint count = (uint)slots.size();
+        uint start = rng() % count;
+        fori(i, count)
+        {
+            uint victim = (start + i) % count;
+            if (victim != self && slots[victim]->tasks.steal(t))
+                return t;
+        }
+        return nullptr;
+    }
+
+    void workerLoop(uint index)
+    {
+        context().pool = this;
+        context().index = index;
+        minstd_rand rng(index + 1);
+
+        for (;;)
+        {
+            task* t = findTask(index, rng);
+            for (int i = 0; i < 64 && t == nullptr; i++)
+            {
+                this_thread::yield();
+                t = findTask(index, rng);
+            }
+
+            if (t == nullptr)
+            {
+                sleeping.fetch_add(1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                size_t seen = epoch.load(memory_order_acquire);
+                t = findTask(index, rng);
+                if (t == nullptr)
+                {
+                    if (stopping.load(memory_order_acquire))
+                    {
+                        sleeping.fetch_sub(1, memory_order_relaxed);
+                        return;
+                    }
+                    unique_lock<mutex> guard(park_lock);
+                    park_cond.wait(guard, [this, seen]()
+                    {
+                        return epoch.load(memory_order_acquire) != seen || stopping.load(memory_order_acquire);
+                    });
+                }
+                sleeping.fetch_sub(1, memory_order_relaxed);
+                if (t == nullptr)
+                    continue;
+            }
+
+            (*t)();
+            delete t;
+        }
+    }
+
+public:
+
+    explicit ThreadPool(uint threads_count = thread::hardware_concurrency())
+        : injected_count(0), sleeping(0), epoch(0), stopping(false)
+    {
+        if (threads_count == 0)
+            threads_count = 1;
+        fori(i, threads_count)
+            slots.push_back(unique_ptr<worker_slot>(new worker_slot()));
+        fori(i, threads_count)
+            workers.push_back(thread(&ThreadPool::workerLoop, this, (uint)i));
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool& operator = (const ThreadPool &) = delete;
+
+    uint size() const
+    {
+        return (uint)workers.size();
+    }
+
+    template <typename F> void submit(F f)
+    {
+        task* t = new task(move(f));
+        worker_context& current = context();
+        if (current.pool == this)
+            slots[current.index]->tasks.push(t);
+        else
+        {
+            lock_guard<mutex> guard(inject_lock);
+            injected.push_back(t);
+            injected_count.fetch_add(1, memory_order_release);
+        }
+        wakeOne();
+    }
+
+    bool run_pending_task()
+    {
+        worker_context& current = context();
+        uint self = current.pool == this ? current.index : (uint)slots.size();
+        static thread_local minstd_rand rng(random_device{}());
+        task* t = findTask(self, rng);
+        if (t == nullptr)
+            return false;
+        (*t)();
+        delete t;
+        return true;
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> guard(park_lock);
+            stopping.store(true, memory_order_release);
+            epoch.fetch_add(1, memory_order_release);
+        }
+        park_cond.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+};
+
+/*
+ * Fork-join helper: run() spawns a task on the pool, wait() executes pending
+ * pool tasks on the calling thread until every spawned task has finished, so
+ * nested groups inside tasks never deadlock.
+ */
+class TaskGroup
+{
+    ThreadPool& pool;
+    atomic<int> pending;
+
+public:
+
+    explicit TaskGroup(ThreadPool& user_pool)
+        : pool(user_pool), pending(0)
+    {
+    }
+
+    template <typename F> void run(F f)
+    {
+        pending.fetch_add(1, memory_order_relaxed);
+        pool.submit([this, f]()
+        {
+            f();
+            pending.fetch_sub(1, memory_order_release);
+        });
+    }
+
+    void wait()
+    {
+        while (pending.load(memory_order_acquire) != 0)
+            if (!pool.run_pending_task())
+                this_thread::yield();
+    }
+
+    ~TaskGroup()
+    {
+        wait();
+    }
+};
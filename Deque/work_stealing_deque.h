@@ -0,0 +1,136 @@
+#pragma once
+#include "base.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Chase-Lev work-stealing deque (in the C11 formulation of Le et al.). The
+ * owner thread pushes and pops at the bottom, any number of thieves steal from
+ * the top. The storage is a power-of-two ring indexed with a mask, like Deque;
+ * when it fills up the owner copies it into a ring twice as large and publishes
+ * the new one. Old rings are kept until destruction because a thief may still
+ * be reading from them, so growth never blocks thieves.
+ *
+ * Elements are read speculatively by thieves, so T must be trivially copyable
+ * (typically a pointer to a task).
+ */
+template <typename T> class WorkStealingDeque
+{
+    static_assert(is_trivially_copyable<T>::value, "WorkStealingDeque needs a trivially copyable T");
+
+    struct ring_array
+    {
+        int64_t capacity, mask;
+        unique_ptr<atomic<T>[]> slots;
+
+        explicit ring_array(int64_t n_capacity)
+            : capacity(n_capacity), mask(n_capacity - 1), slots(new atomic<T>[n_capacity])
+        {
+        }
+
+        T get(int64_t index) const
+        {
+            return slots[index & mask].load(memory_order_relaxed);
+        }
+
+        void put(int64_t index, T value)
+        {
+            slots[index & mask].store(value, memory_order_relaxed);
+        }
+    };
+
+    alignas(cache_line_size) atomic<int64_t> top;
+    alignas(cache_line_size) atomic<int64_t> bottom;
+    alignas(cache_line_size) atomic<ring_array*> array;
+    vector<unique_ptr<ring_array> > rings;
+
+    ring_array* grow(ring_array* old_array, int64_t t, int64_t b)
+    {
+        ring_array* new_array = new ring_array(old_array->capacity << 1);
+        for (int64_t i = t; i < b; i++)
+            new_array->put(i, old_array->get(i));
+        rings.push_back(unique_ptr<ring_array>(new_array));
+        array.store(new_array, memory_order_release);
+        return new_array;
+    }
+
+public:
+
+    explicit WorkStealingDeque(int64_t user_capacity = 64)
+        : top(0), bottom(0)
+    {
+        int64_t capacity = 2;
+        while (capacity < user_capacity)
+            capacity <<= 1;
+        rings.push_back(unique_ptr<ring_array>(new ring_array(capacity)));
+        array.store(rings.back().get(), memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque& operator = (const WorkStealingDeque &) = delete;
+
+    void push(T value)
+    {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+        ring_array* a = array.load(memory_order_relaxed);
+        if (b - t > a->capacity - 1)
+            a = grow(a, t, b);
+        a->put(b, value);
+        bottom.store(b + 1, memory_order_release);
+    }
+
+    bool pop(T& value)
+    {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        ring_array* a = array.load(memory_order_relaxed);
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, memory_order_relaxed);
+            return false;
+        }
+        value = a->get(b);
+        if (t == b)
+        {
+            bool won = top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+            bottom.store(b + 1, memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(T& value)
+    {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b)
+            return false;
+
+        ring_array* a = array.load(memory_order_acquire);
+        T stolen = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return false;
+        value = stolen;
+        return true;
+    }
+
+    int64_t size_approx() const
+    {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const
+    {
+        return size_approx() == 0;
+    }
+};